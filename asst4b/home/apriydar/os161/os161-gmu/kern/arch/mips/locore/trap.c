@@ -36,6 +36,7 @@
 #include <spl.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
@@ -182,6 +183,9 @@ mips_trap(struct trapframe *tf)
 			doadjust = false;
 		}
 
+		/* for CPU accounting in hardclock */
+		curthread->t_intrfromuser = !iskern;
+
 		mainbus_interrupt(tf);
 
 		if (doadjust) {
@@ -192,6 +196,16 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		/*
+		 * If another thread called _exit, leave now (see
+		 * below). Interrupts have to come back on first.
+		 */
+		if (!iskern && curproc->p_exiting) {
+			spl = splhigh();
+			splx(spl);
+			uthread_leave(0);
+		}
 		goto done2;
 	}
 
@@ -227,6 +241,9 @@ mips_trap(struct trapframe *tf)
 	 * Call vm_fault on the TLB exceptions.
 	 * Panic on the bus error exceptions.
 	 */
+	if (code == EX_MOD || code == EX_TLBL || code == EX_TLBS) {
+		curthread->t_usage.cu_nfaults++;
+	}
 	switch (code) {
 	case EX_MOD:
 		if (vm_fault(VM_FAULT_READONLY, tf->tf_vaddr)==0) {
@@ -312,6 +329,14 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+	/*
+	 * On the way back to user mode, if some other thread in this
+	 * process has called _exit, leave the process instead.
+	 */
+	if (!iskern && curproc->p_exiting) {
+		uthread_leave(0);
+	}
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
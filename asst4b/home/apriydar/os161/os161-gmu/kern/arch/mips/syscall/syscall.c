@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/syscall.h>
+#include <kern/sysbatch.h>
 #include <endian.h>
 #include <lib.h>
 #include <mips/trapframe.h>
@@ -41,68 +42,23 @@
 #include <proc.h>
 
 
+static int syscall_batch(struct trapframe *tf, int32_t *retval);
+
 /*
- * System call dispatcher.
- *
- * A pointer to the trapframe created during exception entry (in
- * exception-*.S) is passed in.
- *
- * The calling conventions for syscalls are as follows: Like ordinary
- * function calls, the first 4 32-bit arguments are passed in the 4
- * argument registers a0-a3. 64-bit arguments are passed in *aligned*
- * pairs of registers, that is, either a0/a1 or a2/a3. This means that
- * if the first argument is 32-bit and the second is 64-bit, a1 is
- * unused.
- *
- * This much is the same as the calling conventions for ordinary
- * function calls. In addition, the system call number is passed in
- * the v0 register.
- *
- * On successful return, the return value is passed back in the v0
- * register, or v0 and v1 if 64-bit. This is also like an ordinary
- * function call, and additionally the a3 register is also set to 0 to
- * indicate success.
- *
- * On an error return, the error code is passed back in the v0
- * register, and the a3 register is set to 1 to indicate failure.
- * (Userlevel code takes care of storing the error code in errno and
- * returning the value -1 from the actual userlevel syscall function.
- * See src/user/lib/libc/arch/mips/syscalls-mips.S and related files.)
- *
- * Upon syscall return the program counter stored in the trapframe
- * must be incremented by one instruction; otherwise the exception
- * return code will restart the "syscall" instruction and the system
- * call will repeat forever.
- *
- * If you run out of registers (which happens quickly with 64-bit
- * values) further arguments must be fetched from the user-level
- * stack, starting at sp+16 to skip over the slots for the
- * registerized values, with copyin().
+ * Run the system call described by TF: call number in v0, arguments
+ * in a0-a3 and on the user stack at sp+16. Returns the error code,
+ * and the return value in *RETVAL; 64-bit results also leave the
+ * second word in tf_v1. Used by syscall and syscall_batch.
  */
-void
-syscall(struct trapframe *tf)
+static
+int
+syscall_dispatch(struct trapframe *tf, int32_t *retval)
 {
 	int callno;
-	int32_t retval;
 	int err;
 
-	KASSERT(curthread != NULL);
-	KASSERT(curthread->t_curspl == 0);
-	KASSERT(curthread->t_iplhigh_count == 0);
-
 	callno = tf->tf_v0;
 
-	/*
-	 * Initialize retval to 0. Many of the system calls don't
-	 * really return a value, just 0 for success and -1 on
-	 * error. Since retval is the value returned on success,
-	 * initialize it to 0 by default; thus it's not necessary to
-	 * deal with it except for calls that return other values,
-	 * like write.
-	 */
-
-	retval = 0;
-
 	/* note the casts to userptr_t */
 
 	switch (callno) {
@@ -123,14 +79,14 @@ syscall(struct trapframe *tf)
 			(userptr_t)tf->tf_a0,
 			tf->tf_a1,
 			tf->tf_a2,
-			&retval);
+			retval);
 		break;
 
 	    case SYS_dup2:
 		err = sys_dup2(
 			tf->tf_a0,
 			tf->tf_a1,
-			&retval);
+			retval);
 		break;
 
 	    case SYS_close:
@@ -142,15 +98,58 @@ syscall(struct trapframe *tf)
 			tf->tf_a0,
 			(userptr_t)tf->tf_a1,
 			tf->tf_a2,
-			&retval);
+			retval);
 		break;
 	    case SYS_write:
 		err = sys_write(
 			tf->tf_a0,
 			(userptr_t)tf->tf_a1,
 			tf->tf_a2,
-			&retval);
+			retval);
+		break;
+	    case SYS_readv:
+		err = sys_readv(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				tf->tf_a2, retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				 tf->tf_a2, retval);
+		break;
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_sendfile:
+		err = sys_sendfile(tf->tf_a0, tf->tf_a1, (userptr_t)tf->tf_a2,
+				   tf->tf_a3, retval);
+		break;
+
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The 64-bit offset is aligned, so it skips a3
+			 * and lands on the stack after the four
+			 * argument slots, like lseek's whence.
+			 */
+			uint32_t pos32[2];
+			uint64_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     pos32, sizeof(pos32));
+			if (err) {
+				break;
+			}
+			join32to64(pos32[0], pos32[1], &pos);
+
+			err = (callno == SYS_pread) ?
+				sys_pread(tf->tf_a0, (userptr_t)tf->tf_a1,
+					  tf->tf_a2, pos, retval) :
+				sys_pwrite(tf->tf_a0, (userptr_t)tf->tf_a1,
+					   tf->tf_a2, pos, retval);
+		}
 		break;
+
 	    case SYS_lseek:
 		{
 			/*
@@ -180,10 +179,19 @@ syscall(struct trapframe *tf)
 			}
 
 			split64to32(retval64, &tf->tf_v0, &tf->tf_v1);
-			retval = tf->tf_v0;
+			*retval = tf->tf_v0;
 		}
 		break;
 
+	    case SYS_fcntl:
+		err = sys_fcntl(tf->tf_a0, tf->tf_a1, tf->tf_a2, retval);
+		break;
+
+	    case SYS_poll:
+		err = sys_poll((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+			       retval);
+		break;
+
 	    case SYS_chdir:
 		err = sys_chdir((userptr_t)tf->tf_a0);
 		break;
@@ -192,33 +200,94 @@ syscall(struct trapframe *tf)
 		err = sys___getcwd(
 			(userptr_t)tf->tf_a0,
 			tf->tf_a1,
-			&retval);
+			retval);
 		break;
 
 	    /* process calls */
         case SYS_getpid:
-        err = sys_getpid((pid_t*)&retval);
+        err = sys_getpid((pid_t*)retval);
         break;
 
         case SYS__exit:
-        sys__exit(retval);
+        sys__exit(*retval);
         break;
 
         case SYS_waitpid:
         err = sys_waitpid((pid_t)tf->tf_a0,
                          (userptr_t)tf->tf_a1,
                          (int)tf->tf_a2,
-                         (pid_t*)&retval);
+                         (pid_t*)retval);
         break;
 
         case SYS_fork:
-        err = sys_fork(tf,(pid_t*)&retval);
+        err = sys_fork(tf,(pid_t*)retval);
         break;
 
 	case SYS_execv:
         err = sys_execv((const_userptr_t)tf->tf_a0,
                         (userptr_t)tf->tf_a1);
         break;
+
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_vmstat:
+		err = sys_vmstat((userptr_t)tf->tf_a0, tf->tf_a1, retval);
+		break;
+
+	    case SYS_vfork:
+		err = sys_vfork(tf, (pid_t *)retval);
+		break;
+
+	    case SYS_spawn:
+		err = sys_spawn((const_userptr_t)tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				(const_userptr_t)tf->tf_a2,
+				tf->tf_a3,
+				(pid_t *)retval);
+		break;
+
+	    case SYS_thread_create:
+		err = sys_thread_create((userptr_t)tf->tf_a0,
+					(userptr_t)tf->tf_a1,
+					(userptr_t)tf->tf_a2,
+					retval);
+		break;
+
+	    case SYS_thread_exit:
+		sys_thread_exit(tf->tf_a0);
+		break;
+
+	    case SYS_thread_join:
+		err = sys_thread_join(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex:
+		err = sys_futex((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+				retval);
+		break;
+
+	    case SYS_io_setup:
+		err = sys_io_setup(tf->tf_a0);
+		break;
+
+	    case SYS_io_submit:
+		err = sys_io_submit(tf->tf_a0, (userptr_t)tf->tf_a1, retval);
+		break;
+
+	    case SYS_io_getevents:
+		err = sys_io_getevents(tf->tf_a0, tf->tf_a1,
+				       (userptr_t)tf->tf_a2, retval);
+		break;
+
+	    case SYS_io_destroy:
+		err = sys_io_destroy();
+		break;
+
+	    case SYS_syscall_batch:
+		err = syscall_batch(tf, retval);
+		break;
 	
 	default:
 		kprintf("Unknown syscall %d\n", callno);
@@ -227,6 +296,150 @@ syscall(struct trapframe *tf)
 	}
 
 
+	return err;
+}
+
+/*
+ * syscall_batch() - run several system calls in one trap; see
+ * <kern/sysbatch.h>.
+ *
+ * Each call goes through syscall_dispatch with a trapframe made up
+ * from its descriptor. The made-up sp points at sd_args, so a call
+ * that fetches arguments from sp+16 gets sd_args[4] and on, which is
+ * where the caller put them.
+ */
+static
+int
+syscall_batch(struct trapframe *tf, int32_t *retval)
+{
+	userptr_t udescs = (userptr_t)tf->tf_a0;
+	unsigned n = tf->tf_a1;
+	int flags = tf->tf_a2;
+	struct syscall_desc sd;
+	struct trapframe btf;
+	userptr_t ud;
+	unsigned i;
+	int err;
+
+	if (n > SYSBATCH_MAX || (flags & ~SYSBATCH_STOPONERR) != 0) {
+		return EINVAL;
+	}
+
+	for (i=0; i<n; i++) {
+		if (curproc->p_exiting) {
+			/* another thread called _exit; don't keep going */
+			break;
+		}
+
+		ud = udescs + i * sizeof(sd);
+		err = copyin(ud, &sd, sizeof(sd));
+		if (err) {
+			if (i == 0) {
+				return err;
+			}
+			break;
+		}
+
+		sd.sd_retval = 0;
+		sd.sd_retval2 = 0;
+		switch (sd.sd_callno) {
+		    case SYS_fork:
+		    case SYS_vfork:
+		    case SYS_execv:
+		    case SYS__exit:
+		    case SYS_thread_exit:
+		    case SYS_syscall_batch:
+			/* these need the real trapframe, or don't return */
+			sd.sd_error = EINVAL;
+			break;
+		    default:
+			bzero(&btf, sizeof(btf));
+			btf.tf_v0 = sd.sd_callno;
+			btf.tf_a0 = sd.sd_args[0];
+			btf.tf_a1 = sd.sd_args[1];
+			btf.tf_a2 = sd.sd_args[2];
+			btf.tf_a3 = sd.sd_args[3];
+			btf.tf_sp = (vaddr_t)ud +
+				((char *)sd.sd_args - (char *)&sd);
+			sd.sd_error = syscall_dispatch(&btf, &sd.sd_retval);
+			sd.sd_retval2 = btf.tf_v1;
+			break;
+		}
+
+		err = copyout(&sd, ud, sizeof(sd));
+		if (err || (sd.sd_error && (flags & SYSBATCH_STOPONERR))) {
+			/* it ran, so count it */
+			i++;
+			break;
+		}
+	}
+
+	*retval = i;
+	return 0;
+}
+
+/*
+ * System call dispatcher.
+ *
+ * A pointer to the trapframe created during exception entry (in
+ * exception-*.S) is passed in.
+ *
+ * The calling conventions for syscalls are as follows: Like ordinary
+ * function calls, the first 4 32-bit arguments are passed in the 4
+ * argument registers a0-a3. 64-bit arguments are passed in *aligned*
+ * pairs of registers, that is, either a0/a1 or a2/a3. This means that
+ * if the first argument is 32-bit and the second is 64-bit, a1 is
+ * unused.
+ *
+ * This much is the same as the calling conventions for ordinary
+ * function calls. In addition, the system call number is passed in
+ * the v0 register.
+ *
+ * On successful return, the return value is passed back in the v0
+ * register, or v0 and v1 if 64-bit. This is also like an ordinary
+ * function call, and additionally the a3 register is also set to 0 to
+ * indicate success.
+ *
+ * On an error return, the error code is passed back in the v0
+ * register, and the a3 register is set to 1 to indicate failure.
+ * (Userlevel code takes care of storing the error code in errno and
+ * returning the value -1 from the actual userlevel syscall function.
+ * See src/user/lib/libc/arch/mips/syscalls-mips.S and related files.)
+ *
+ * Upon syscall return the program counter stored in the trapframe
+ * must be incremented by one instruction; otherwise the exception
+ * return code will restart the "syscall" instruction and the system
+ * call will repeat forever.
+ *
+ * If you run out of registers (which happens quickly with 64-bit
+ * values) further arguments must be fetched from the user-level
+ * stack, starting at sp+16 to skip over the slots for the
+ * registerized values, with copyin().
+ */
+void
+syscall(struct trapframe *tf)
+{
+	int32_t retval;
+	int err;
+
+	KASSERT(curthread != NULL);
+	KASSERT(curthread->t_curspl == 0);
+	KASSERT(curthread->t_iplhigh_count == 0);
+
+	/*
+	 * Initialize retval to 0. Many of the system calls don't
+	 * really return a value, just 0 for success and -1 on
+	 * error. Since retval is the value returned on success,
+	 * initialize it to 0 by default; thus it's not necessary to
+	 * deal with it except for calls that return other values,
+	 * like write.
+	 */
+
+	retval = 0;
+
+	err = syscall_dispatch(tf, &retval);
+
+
 	if (err) {
 		/*
 		 * Return the error code. This gets converted at
@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <bitmap.h>
 #include <spl.h>
 #include <spinlock.h>
 #include <proc.h>
@@ -58,6 +59,11 @@
 /* (this must be > 64K so argument blocks of size ARG_MAX will fit) */
 #define DUMBVM_STACKPAGES    18
 
+/* Region numbers, for the vmstat counts */
+#define DUMBVM_REGION1       0
+#define DUMBVM_REGION2       1
+#define DUMBVM_STACK         2
+
 /*
  * Wrap ram_stealmem in a spinlock.
  */
@@ -116,11 +122,37 @@ vm_tlbshootdown(const struct tlbshootdown *ts)
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
+/*
+ * Count a fault on page PAGE of region REGION for vmstat.
+ */
+static
+void
+dumbvm_countfault(struct addrspace *as, unsigned region, unsigned page,
+		  int faulttype)
+{
+	struct vmregionstat *vr;
+
+	spinlock_acquire(&as->as_statlock);
+	vr = &as->as_stats[region];
+	if (faulttype == VM_FAULT_READONLY) {
+		vr->vr_readonly++;
+	}
+	else if (bitmap_isset(as->as_touched[region], page)) {
+		vr->vr_tlbrefills++;
+	}
+	else {
+		bitmap_mark(as->as_touched[region], page);
+		vr->vr_firsttouch++;
+	}
+	spinlock_release(&as->as_statlock);
+}
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
 	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
 	paddr_t paddr;
+	unsigned region, page;
 	int i;
 	uint32_t ehi, elo;
 	struct addrspace *as;
@@ -132,8 +164,6 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -182,17 +212,32 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	if (faultaddress >= vbase1 && faultaddress < vtop1) {
 		paddr = (faultaddress - vbase1) + as->as_pbase1;
+		region = DUMBVM_REGION1;
+		page = (faultaddress - vbase1) / PAGE_SIZE;
 	}
 	else if (faultaddress >= vbase2 && faultaddress < vtop2) {
 		paddr = (faultaddress - vbase2) + as->as_pbase2;
+		region = DUMBVM_REGION2;
+		page = (faultaddress - vbase2) / PAGE_SIZE;
 	}
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
+		region = DUMBVM_STACK;
+		page = (faultaddress - stackbase) / PAGE_SIZE;
 	}
 	else {
 		return EFAULT;
 	}
 
+	dumbvm_countfault(as, region, page, faulttype);
+	if (faulttype == VM_FAULT_READONLY) {
+		/*
+		 * We always create pages read-write, so we shouldn't get
+		 * this; if we do, it's counted, and the access fails.
+		 */
+		return EFAULT;
+	}
+
 	/* make sure it's page-aligned */
 	KASSERT((paddr & PAGE_FRAME) == paddr);
 
@@ -220,6 +265,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 struct addrspace *
 as_create(void)
 {
+	int i;
 	struct addrspace *as = kmalloc(sizeof(struct addrspace));
 	if (as==NULL) {
 		return NULL;
@@ -233,12 +279,26 @@ as_create(void)
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
 
+	spinlock_init(&as->as_statlock);
+	bzero(as->as_stats, sizeof(as->as_stats));
+	for (i=0; i<VMSTAT_MAXREGIONS; i++) {
+		as->as_touched[i] = NULL;
+	}
+
 	return as;
 }
 
 void
 as_destroy(struct addrspace *as)
 {
+	int i;
+
+	for (i=0; i<VMSTAT_MAXREGIONS; i++) {
+		if (as->as_touched[i] != NULL) {
+			bitmap_destroy(as->as_touched[i]);
+		}
+	}
+	spinlock_cleanup(&as->as_statlock);
 	kfree(as);
 }
 
@@ -337,6 +397,16 @@ as_prepare_load(struct addrspace *as)
 		return ENOMEM;
 	}
 
+	as->as_touched[DUMBVM_REGION1] = bitmap_create(as->as_npages1);
+	as->as_touched[DUMBVM_REGION2] = bitmap_create(as->as_npages2);
+	as->as_touched[DUMBVM_STACK] = bitmap_create(DUMBVM_STACKPAGES);
+	if (as->as_touched[DUMBVM_REGION1] == NULL ||
+	    as->as_touched[DUMBVM_REGION2] == NULL ||
+	    as->as_touched[DUMBVM_STACK] == NULL) {
+		/* as_destroy frees whichever we got */
+		return ENOMEM;
+	}
+
 	as_zero_region(as->as_pbase1, as->as_npages1);
 	as_zero_region(as->as_pbase2, as->as_npages2);
 	as_zero_region(as->as_stackpbase, DUMBVM_STACKPAGES);
@@ -360,6 +430,33 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+unsigned
+as_getstats(struct addrspace *as, struct vmregionstat *stats, unsigned max)
+{
+	unsigned i;
+
+	spinlock_acquire(&as->as_statlock);
+	for (i=0; i<VMSTAT_MAXREGIONS && i<max; i++) {
+		stats[i] = as->as_stats[i];
+	}
+	spinlock_release(&as->as_statlock);
+
+	if (max > DUMBVM_REGION1) {
+		stats[DUMBVM_REGION1].vr_vbase = as->as_vbase1;
+		stats[DUMBVM_REGION1].vr_npages = as->as_npages1;
+	}
+	if (max > DUMBVM_REGION2) {
+		stats[DUMBVM_REGION2].vr_vbase = as->as_vbase2;
+		stats[DUMBVM_REGION2].vr_npages = as->as_npages2;
+	}
+	if (max > DUMBVM_STACK) {
+		stats[DUMBVM_STACK].vr_vbase =
+			USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+		stats[DUMBVM_STACK].vr_npages = DUMBVM_STACKPAGES;
+	}
+	return VMSTAT_MAXREGIONS;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -39,6 +39,17 @@
  * supported, although such support could be added without undue
  * difficulty.
  *
+ * Input goes into a ring buffer from the interrupt handler. Reads
+ * through the VFS are line at a time, with erase and kill; they can
+ * be O_NONBLOCK, and the console can be poll()ed for input.
+ *
+ * Output goes into another ring buffer, which the write-done
+ * interrupt drains one character at a time; writers only wait when
+ * it's full, and not for long, so the console is always reported
+ * writable. Polled output (from interrupt handlers, with interrupts
+ * off, or during panic) empties the ring first so nothing comes out
+ * of order.
+ *
  * Note that nothing happens until we have a device to write to. A
  * buffer of size DELAYBUFSIZE is used to hold output that is
  * generated before this point. This means that (1) using kprintf for
@@ -49,12 +60,16 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <cpu.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 #include <synch.h>
+#include <wchan.h>
+#include <poll.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -72,6 +87,16 @@ static struct con_softc *the_console = NULL;
 static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
+/*
+ * Pollers waiting for input.
+ */
+static struct pollqueue con_pollq;
+
+/*
+ * Size of the pieces user writes are copied in.
+ */
+#define CON_WRITECHUNK  256
+
 //////////////////////////////////////////////////
 
 /*
@@ -109,19 +134,129 @@ flush_delay_buf(void)
 
 //////////////////////////////////////////////////
 
+/*
+ * Number of characters waiting in the output ring. It's full at
+ * CONSOLE_OUTPUT_BUFFER_SIZE-1.
+ */
+static
+unsigned
+outbuf_used(struct con_softc *cs)
+{
+	return (cs->cs_outhead + CONSOLE_OUTPUT_BUFFER_SIZE - cs->cs_outtail)
+		% CONSOLE_OUTPUT_BUFFER_SIZE;
+}
+
+/*
+ * Wake writers waiting for room, once the ring is down to half full
+ * so they don't get woken for every character.
+ */
+static
+void
+outbuf_wakeup(struct con_softc *cs)
+{
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (cs->cs_outwaiters > 0 &&
+	    outbuf_used(cs) <= CONSOLE_OUTPUT_BUFFER_SIZE / 2) {
+		wchan_wakeall(cs->cs_outwchan, &cs->cs_outlock);
+	}
+}
+
+/*
+ * If the device is idle, hand it the next character from the ring.
+ */
+static
+void
+outbuf_start(struct con_softc *cs)
+{
+	int ch;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (cs->cs_outbusy || cs->cs_outhead == cs->cs_outtail) {
+		return;
+	}
+	ch = cs->cs_outbuf[cs->cs_outtail];
+	cs->cs_outtail = (cs->cs_outtail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	cs->cs_outbusy = true;
+	cs->cs_send(cs->cs_devdata, ch);
+}
+
+/*
+ * Add a character to the output ring, waiting for room if it's full.
+ */
+static
+void
+outbuf_put(struct con_softc *cs, int ch)
+{
+	unsigned nexthead;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	nexthead = (cs->cs_outhead + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	while (nexthead == cs->cs_outtail) {
+		outbuf_start(cs);
+		cs->cs_outwaiters++;
+		wchan_sleep(cs->cs_outwchan, &cs->cs_outlock);
+		cs->cs_outwaiters--;
+	}
+	cs->cs_outbuf[cs->cs_outhead] = ch;
+	cs->cs_outhead = nexthead;
+}
+
+//////////////////////////////////////////////////
+
 /*
  * Print a character, using polling instead of interrupts to wait for
- * I/O completion.
+ * I/O completion. Anything still in the output ring goes first.
+ *
+ * The one time we can already hold cs_outlock here is if cs_send
+ * panics; then just print.
  */
 static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	if (spinlock_do_i_hold(&cs->cs_outlock)) {
+		cs->cs_sendpolled(cs->cs_devdata, ch);
+		return;
+	}
+
+	spinlock_acquire(&cs->cs_outlock);
+	while (cs->cs_outhead != cs->cs_outtail) {
+		cs->cs_sendpolled(cs->cs_devdata,
+				  cs->cs_outbuf[cs->cs_outtail]);
+		cs->cs_outtail =
+			(cs->cs_outtail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	}
+	outbuf_wakeup(cs);
 	cs->cs_sendpolled(cs->cs_devdata, ch);
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
 
+/*
+ * Print LEN characters, using interrupts to wait for I/O completion.
+ * If CRLF is set, newlines go out as \r\n.
+ */
+static
+void
+write_intr(struct con_softc *cs, const char *buf, size_t len, bool crlf)
+{
+	size_t i;
+
+	spinlock_acquire(&cs->cs_outlock);
+	for (i=0; i<len; i++) {
+		if (crlf && buf[i]=='\n') {
+			outbuf_put(cs, '\r');
+		}
+		outbuf_put(cs, buf[i]);
+	}
+	outbuf_start(cs);
+	spinlock_release(&cs->cs_outlock);
+}
+
 /*
  * Print a character, using interrupts to wait for I/O completion.
  */
@@ -129,23 +264,89 @@ static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	char c = ch;
+
+	write_intr(cs, &c, 1, false);
 }
 
 /*
- * Read a character, using interrupts to wait for I/O completion.
+ * Line ends, as typed. Reads turn \r into \n.
+ */
+#define ISLINEEND(ch)  ((ch) == '\n' || (ch) == '\r')
+
+/*
+ * Line editing characters for reads: backspace or DEL erases a
+ * character, ^U the line so far.
+ */
+#define CH_ERASE1  8
+#define CH_ERASE2  127
+#define CH_KILL    21
+
+/*
+ * Number of characters waiting in the input ring.
  */
 static
-int
-getch_intr(struct con_softc *cs)
+unsigned
+inbuf_used(struct con_softc *cs)
+{
+	return (cs->cs_gotchars_head + CONSOLE_INPUT_BUFFER_SIZE
+		- cs->cs_gotchars_tail) % CONSOLE_INPUT_BUFFER_SIZE;
+}
+
+/*
+ * Take the next character out of the input ring, which must not be
+ * empty.
+ */
+static
+unsigned char
+inbuf_take(struct con_softc *cs)
 {
 	unsigned char ret;
 
-	P(cs->cs_rsem);
+	KASSERT(spinlock_do_i_hold(&cs->cs_inlock));
+	KASSERT(cs->cs_gotchars_head != cs->cs_gotchars_tail);
+
 	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
 	cs->cs_gotchars_tail =
 		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
+	if (ISLINEEND(ret)) {
+		KASSERT(cs->cs_gotlines > 0);
+		cs->cs_gotlines--;
+	}
+	return ret;
+}
+
+/*
+ * Check if a read has something to take: a whole line, or enough of
+ * a long one that the ring is getting full.
+ */
+static
+bool
+inbuf_ready(struct con_softc *cs)
+{
+	KASSERT(spinlock_do_i_hold(&cs->cs_inlock));
+
+	return cs->cs_gotlines > 0 ||
+		inbuf_used(cs) >= CONSOLE_INPUT_WATERMARK;
+}
+
+/*
+ * Read a character, using interrupts to wait for I/O completion.
+ */
+static
+int
+getch_intr(struct con_softc *cs)
+{
+	unsigned char ret;
+
+	spinlock_acquire(&cs->cs_inlock);
+	while (cs->cs_gotchars_head == cs->cs_gotchars_tail) {
+		cs->cs_getchwaiters++;
+		wchan_sleep(cs->cs_inwchan, &cs->cs_inlock);
+		cs->cs_getchwaiters--;
+	}
+	ret = inbuf_take(cs);
+	spinlock_release(&cs->cs_inlock);
 	return ret;
 }
 
@@ -153,27 +354,44 @@ getch_intr(struct con_softc *cs)
  * Called from underlying device when a read-ready interrupt occurs.
  *
  * Note: if gotchars_head == gotchars_tail, the buffer is empty. Thus
- * if gotchars_head+1 == gotchars_tail, the buffer is full. A slightly
- * tidier way to implement this check (that avoids wasting a slot,
- * too) would be with a second semaphore used with a nonblocking P,
- * but we don't have that in OS/161.
+ * if gotchars_head+1 == gotchars_tail, the buffer is full.
+ *
+ * Readers through the VFS only get woken when a line is finished or
+ * the ring passes the watermark; getch callers (kgets, which echoes
+ * as it goes) get woken for every character.
  */
 void
 con_input(void *vcs, int ch)
 {
 	struct con_softc *cs = vcs;
 	unsigned nexthead;
+	bool wasready, ready;
 
+	spinlock_acquire(&cs->cs_inlock);
 	nexthead = (cs->cs_gotchars_head + 1) % CONSOLE_INPUT_BUFFER_SIZE;
 	if (nexthead == cs->cs_gotchars_tail) {
 		/* overflow; drop character */
+		spinlock_release(&cs->cs_inlock);
 		return;
 	}
 
+	wasready = inbuf_ready(cs);
 	cs->cs_gotchars[cs->cs_gotchars_head] = ch;
 	cs->cs_gotchars_head = nexthead;
+	if (ISLINEEND(ch)) {
+		cs->cs_gotlines++;
+	}
+	ready = inbuf_ready(cs);
 
-	V(cs->cs_rsem);
+	if ((ready && (!wasready || ISLINEEND(ch))) ||
+	    cs->cs_getchwaiters > 0) {
+		wchan_wakeall(cs->cs_inwchan, &cs->cs_inlock);
+	}
+	spinlock_release(&cs->cs_inlock);
+
+	if (ready && !wasready) {
+		pollqueue_wakeup(&con_pollq);
+	}
 }
 
 /*
@@ -184,7 +402,11 @@ con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
 
-	V(cs->cs_wsem);
+	spinlock_acquire(&cs->cs_outlock);
+	cs->cs_outbusy = false;
+	outbuf_start(cs);
+	outbuf_wakeup(cs);
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
@@ -240,57 +462,170 @@ con_eachopen(struct device *dev, int openflags)
 	return 0;
 }
 
+/*
+ * Take up to LEN characters of the current line out of the input
+ * ring into BUF, applying the line editing characters, and return
+ * how many ended up in BUF. *GOTEND says whether the line end was
+ * reached.
+ */
+static
+size_t
+inbuf_getline(struct con_softc *cs, char *buf, size_t len, bool *gotend)
+{
+	size_t pos = 0;
+	unsigned char ch;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_inlock));
+
+	*gotend = false;
+	while (pos < len && cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+		ch = inbuf_take(cs);
+		if (ISLINEEND(ch)) {
+			buf[pos++] = '\n';
+			*gotend = true;
+			break;
+		}
+		else if (ch == CH_ERASE1 || ch == CH_ERASE2) {
+			if (pos > 0) {
+				pos--;
+			}
+		}
+		else if (ch == CH_KILL) {
+			pos = 0;
+		}
+		else {
+			buf[pos++] = ch;
+		}
+	}
+	return pos;
+}
+
+/*
+ * Read a line. We wait for a whole line (or a ring full of a long
+ * one) before taking the read lock, so that a reader waiting for
+ * someone to type doesn't hold up an O_NONBLOCK one, and then hand
+ * it over with one uiomove. If the line was longer than the ring,
+ * what we got is returned and the rest comes with the next read. An
+ * O_NONBLOCK read gets EAGAIN if there isn't a line yet, and one in
+ * a process that's exiting gives up with EINTR.
+ *
+ * Erasing only works within what one read takes, so the line
+ * editing characters can't reach back into a piece of a long line
+ * that's already been returned.
+ */
 static
 int
-con_io(struct device *dev, struct uio *uio)
+con_read(struct con_softc *cs, struct uio *uio)
 {
+	char buf[CONSOLE_INPUT_BUFFER_SIZE];
+	size_t len, pos;
+	bool gotend, sleeping = false;
 	int result;
-	char ch;
-	struct lock *lk;
 
-	(void)dev;  // unused
+	KASSERT(con_userlock_read != NULL);
 
-	if (uio->uio_rw==UIO_READ) {
-		lk = con_userlock_read;
+	len = uio->uio_resid < sizeof(buf) ? uio->uio_resid : sizeof(buf);
+	if (len == 0) {
+		return 0;
 	}
-	else {
-		lk = con_userlock_write;
-	}
-
-	KASSERT(lk != NULL);
-	lock_acquire(lk);
 
-	while (uio->uio_resid > 0) {
-		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
-			if (ch=='\r') {
-				ch = '\n';
-			}
-			result = uiomove(&ch, 1, uio);
+	pos = 0;
+	gotend = false;
+	while (pos == 0 && !gotend) {
+		result = 0;
+		spinlock_acquire(&cs->cs_inlock);
+		while (!inbuf_ready(cs)) {
+			result = uio->uio_nonblock ? EAGAIN :
+				proc_sleep(cs->cs_inwchan, &cs->cs_inlock,
+					   &sleeping);
 			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
 				break;
 			}
 		}
-		else {
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				putch('\r');
-			}
-			putch(ch);
+		spinlock_release(&cs->cs_inlock);
+		if (sleeping) {
+			proc_sleepend();
+			sleeping = false;
+		}
+		if (result) {
+			return result;
+		}
+
+		lock_acquire(con_userlock_read);
+		spinlock_acquire(&cs->cs_inlock);
+		if (inbuf_ready(cs)) {
+			pos = inbuf_getline(cs, buf, len, &gotend);
+		}
+		spinlock_release(&cs->cs_inlock);
+		if (pos == 0 && !gotend) {
+			/* someone else got it, or it was all erased */
+			lock_release(con_userlock_read);
+		}
+	}
+
+	result = uiomove(buf, pos, uio);
+	lock_release(con_userlock_read);
+	return result;
+}
+
+/*
+ * Write, a chunk at a time, into the output ring. The write lock
+ * keeps writes that have to wait for room from getting mixed up.
+ */
+static
+int
+con_write(struct con_softc *cs, struct uio *uio)
+{
+	char buf[CON_WRITECHUNK];
+	size_t len;
+	int result;
+
+	KASSERT(con_userlock_write != NULL);
+	lock_acquire(con_userlock_write);
+
+	while (uio->uio_resid > 0) {
+		len = uio->uio_resid < sizeof(buf) ?
+			uio->uio_resid : sizeof(buf);
+		result = uiomove(buf, len, uio);
+		if (result) {
+			lock_release(con_userlock_write);
+			return result;
 		}
+		write_intr(cs, buf, len, true);
 	}
-	lock_release(lk);
+	lock_release(con_userlock_write);
 	return 0;
 }
 
+static
+int
+con_io(struct device *dev, struct uio *uio)
+{
+	if (uio->uio_rw==UIO_READ) {
+		return con_read(dev->d_data, uio);
+	}
+	return con_write(dev->d_data, uio);
+}
+
+/*
+ * Poll: readable when a read would find a line; always writable.
+ */
+static
+int
+con_poll(struct device *dev, struct poller *pl)
+{
+	struct con_softc *cs = dev->d_data;
+	int ready = POLLOUT;
+
+	poller_add(pl, &con_pollq);
+	spinlock_acquire(&cs->cs_inlock);
+	if (inbuf_ready(cs)) {
+		ready |= POLLIN;
+	}
+	spinlock_release(&cs->cs_inlock);
+	return ready;
+}
+
 static
 int
 con_ioctl(struct device *dev, int op, userptr_t data)
@@ -306,6 +641,7 @@ static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -343,7 +679,7 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct wchan *inwchan, *outwchan;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -359,37 +695,46 @@ config_con(struct con_softc *cs, int unit)
 	}
 	KASSERT(the_console==NULL);
 
-	rsem = sem_create("console read", 0);
-	if (rsem == NULL) {
+	inwchan = wchan_create("console read");
+	if (inwchan == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
-		sem_destroy(rsem);
+	outwchan = wchan_create("console write");
+	if (outwchan == NULL) {
+		wchan_destroy(inwchan);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(inwchan);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(inwchan);
+		wchan_destroy(outwchan);
 		return ENOMEM;
 	}
 
-	cs->cs_rsem = rsem;
-	cs->cs_wsem = wsem;
+	spinlock_init(&cs->cs_inlock);
+	cs->cs_inwchan = inwchan;
+	cs->cs_getchwaiters = 0;
+	cs->cs_gotlines = 0;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outwchan = outwchan;
+	cs->cs_outwaiters = 0;
+	cs->cs_outbusy = false;
+	cs->cs_outhead = 0;
+	cs->cs_outtail = 0;
 
 	the_console = cs;
 	con_userlock_read = rlk;
 	con_userlock_write = wlk;
+	pollqueue_init(&con_pollq);
 
 	flush_delay_buf();
 
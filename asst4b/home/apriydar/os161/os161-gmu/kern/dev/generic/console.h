@@ -37,7 +37,13 @@
  * device, and are to be initialized by the attach routine.
  */
 
-#define CONSOLE_INPUT_BUFFER_SIZE 32
+#include <spinlock.h>
+
+struct wchan;
+
+#define CONSOLE_INPUT_BUFFER_SIZE 256
+#define CONSOLE_INPUT_WATERMARK (CONSOLE_INPUT_BUFFER_SIZE * 3 / 4)
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -46,11 +52,21 @@ struct con_softc {
 	void (*cs_sendpolled)(void *devdata, int ch);
 
 	/* initialized by config routine */
-	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
+	struct spinlock cs_inlock;	/* for the input ring and counts */
+	struct wchan *cs_inwchan;	/* readers wait here for input */
+	unsigned cs_getchwaiters;	/* # of getch callers waiting */
+	unsigned cs_gotlines;		/* # of line ends in cs_gotchars */
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+
+	struct spinlock cs_outlock;	/* for the output ring and cs_outbusy */
+	struct wchan *cs_outwchan;	/* writers wait here for room */
+	unsigned cs_outwaiters;		/* # of writers waiting */
+	bool cs_outbusy;		/* device is sending a char */
+	char cs_outbuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_outhead;		/* next slot to put a char in */
+	unsigned cs_outtail;		/* next slot to take a char out */
 };
 
 /*
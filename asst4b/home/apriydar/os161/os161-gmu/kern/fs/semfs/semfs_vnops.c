@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <uio.h>
 #include <synch.h>
@@ -136,7 +137,8 @@ semfs_getsem(struct semfs_vnode *semv)
  * Wakeup helper. We only need to wake up if there are sleepers, which
  * should only be the case if the old count is 0; and we only
  * potentially need to wake more than one sleeper if the new count
- * will be more than 1.
+ * will be more than 1. Pollers likewise only care about the count
+ * going from 0 to something.
  */
 static
 void
@@ -151,6 +153,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollqueue_wakeup(&sem->sems_pollq);
 }
 
 /*
@@ -182,7 +185,8 @@ semfs_semstat(struct vnode *vn, struct stat *buf)
 
 /*
  * Read. This is P(); decrease the count by the amount read.
- * Don't actually bother to transfer any data.
+ * Don't actually bother to transfer any data. With O_NONBLOCK, take
+ * what's there; if that's nothing, fail with EAGAIN.
  */
 static
 int
@@ -190,9 +194,10 @@ semfs_read(struct vnode *vn, struct uio *uio)
 {
 	struct semfs_vnode *semv = vn->vn_data;
 	struct semfs_sem *sem;
-	size_t consume;
+	size_t consume, startresid;
 
 	sem = semfs_getsem(semv);
+	startresid = uio->uio_resid;
 
 	lock_acquire(sem->sems_lock);
 	while (uio->uio_resid > 0) {
@@ -211,6 +216,10 @@ semfs_read(struct vnode *vn, struct uio *uio)
 		if (uio->uio_resid == 0) {
 			break;
 		}
+		if (sem->sems_count == 0 && uio->uio_nonblock) {
+			lock_release(sem->sems_lock);
+			return uio->uio_resid == startresid ? EAGAIN : 0;
+		}
 		if (sem->sems_count == 0) {
 			DEBUG(DB_SEMFS, "semfs: sem%u: blocking\n",
 			      semv->semv_semnum);
@@ -253,6 +262,29 @@ semfs_write(struct vnode *vn, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Poll. Readable (P won't wait) when the count isn't 0; always
+ * writable.
+ */
+static
+int
+semfs_poll(struct vnode *vn, struct poller *pl)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+	int ready = POLLOUT;
+
+	sem = semfs_getsem(semv);
+
+	poller_add(pl, &sem->sems_pollq);
+	lock_acquire(sem->sems_lock);
+	if (sem->sems_count > 0) {
+		ready |= POLLIN;
+	}
+	lock_release(sem->sems_lock);
+	return ready;
+}
+
 /*
  * Truncate. Set the count to the specified value.
  *
@@ -697,6 +729,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = semfs_poll,
 
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
@@ -36,9 +36,12 @@
 
 
 #include <vm.h>
+#include <spinlock.h>
+#include <kern/vmstat.h>
 #include "opt-dumbvm.h"
 
 struct vnode;
+struct bitmap;
 
 
 /*
@@ -57,6 +60,14 @@ struct addrspace {
         paddr_t as_pbase2;
         size_t as_npages2;
         paddr_t as_stackpbase;
+
+        /*
+         * Fault counts for vmstat, per region (1, 2, stack), and
+         * which pages have been touched so far.
+         */
+        struct spinlock as_statlock;
+        struct vmregionstat as_stats[VMSTAT_MAXREGIONS];
+        struct bitmap *as_touched[VMSTAT_MAXREGIONS];
 #else
         /* Put stuff here for your VM system */
 #endif
@@ -99,6 +110,9 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_getstats - copy the fault counts of up to MAX regions into
+ *                STATS, and return how many regions there are.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -117,16 +131,22 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+unsigned          as_getstats(struct addrspace *as,
+                              struct vmregionstat *stats, unsigned max);
 
 
 /*
  * Functions in loadelf.c
  *    load_elf - load an ELF user program executable into the current
  *               address space. Returns the entry point (initial PC)
- *               in the space pointed to by ENTRYPOINT.
+ *               in the space pointed to by ENTRYPOINT. Parsed
+ *               headers are cached per vnode version, so running the
+ *               same binary again only reads its segments.
+ *    load_elf_stats - report header cache hits and misses.
  */
 
 int load_elf(struct vnode *v, vaddr_t *entrypoint);
+void load_elf_stats(unsigned *hits, unsigned *misses);
 
 
 #endif /* _ADDRSPACE_H_ */
@@ -59,6 +59,7 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Exited threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
@@ -110,6 +111,12 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Return the number of cpus. Only final after thread_start_cpus.
+ * Valid cpu numbers (c_number) run from 0 to one less than this.
+ */
+unsigned cpu_numcpus(void);
+
 /*
  * Produce a string describing the CPU type.
  */
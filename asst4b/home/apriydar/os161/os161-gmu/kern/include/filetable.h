@@ -35,28 +35,33 @@
 #define _FILETABLE_H_
 
 #include <limits.h> /* for OPEN_MAX */
+#include <spinlock.h>
 
 
 /*
- * The file table is an array of open files.
+ * The file table is an array of open files that grows as needed, up
+ * to OPEN_MAX slots. It starts with FT_MINSIZE; most processes never
+ * get past that.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * ft_used has a bit per slot, set when the slot holds a file, so the
+ * lowest free descriptor is found a word at a time and copy/destroy
+ * only visit the slots that are open. A slot's pointer means nothing
+ * when its bit is clear and isn't initialized.
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * The threads of a process share its file table, so everything in it
+ * is protected by ft_lock. On fork, the table is copied.
+ * filetable_get hands out its own reference to the openfile, which
+ * filetable_put drops, so if one thread calls close() while another
+ * is in the middle of e.g. read() on the same file handle, the file
+ * stays open until the read is done with it.
  */
+#define FT_MINSIZE	32	/* slots to start with; a multiple of 32 */
+
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct spinlock ft_lock;	/* protects everything below */
+	unsigned ft_size;		/* number of slots */
+	struct openfile **ft_openfiles;	/* the slots */
+	uint32_t *ft_used;		/* bitmap of slots in use */
 };
 
 /*
@@ -65,11 +70,15 @@ struct filetable {
  * create -  Construct an empty file table.
  * destroy - Wipe out a file table, closing anything open in it.
  * copy -    Clone a file table.
- * okfd -    Check if a file handle is in range.
+ * okfd -    Check if a file handle is in range (below OPEN_MAX; the
+ *           table need not be that big yet).
  * get/put - Retrieve a fd for use and put it back when done. (Checks
  *           okfd and also fails on files not open; returned openfile
- *           is not NULL.) Call put with the file returned from get.
+ *           is not NULL, and holds a reference that put releases.)
+ *           Call put with the file returned from get.
  * place -   Insert a file and return the fd.
+ * reserve - Grow the table to include a specific slot. Call before
+ *           placeat with a non-NULL file.
  * placeat - Insert a file at a specific slot and return the file
  *           previously there.
  */
@@ -83,6 +92,7 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
+int filetable_reserve(struct filetable *ft, int fd);
 void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		       struct openfile **oldfile_ret);
 
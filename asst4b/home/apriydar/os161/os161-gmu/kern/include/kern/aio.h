@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_AIO_H_
+#define _KERN_AIO_H_
+
+/*
+ * Definitions for the asynchronous I/O system calls.
+ *
+ * io_setup(maxevents) gives the process a context that can have up
+ * to MAXEVENTS requests outstanding, that is, submitted and not yet
+ * collected. io_submit(nr, iocbpp) starts the NR requests pointed to
+ * by the array IOCBPP and returns how many it started; each one is
+ * carried out by a kernel worker thread while the process goes on.
+ * io_getevents(min_nr, nr, events) waits until at least MIN_NR
+ * requests have finished (with MIN_NR 0 it just looks), collects up
+ * to NR of them into EVENTS, and returns how many it collected. The
+ * data for a read lands in its buffer when its event is collected.
+ * io_destroy() waits for anything still running and throws the
+ * results away; so does exiting.
+ */
+
+struct iocb {
+	unsigned long cb_data;		/* handed back in the event */
+	int cb_opcode;			/* IOCB_CMD_* */
+	int cb_fd;			/* file to read or write */
+#ifdef _KERNEL
+	userptr_t cb_ubuf;		/* user buffer */
+#else
+	void *cb_buf;
+#endif
+	size_t cb_nbytes;		/* how much */
+	off_t cb_offset;		/* where in the file */
+};
+
+struct io_event {
+	unsigned long ev_data;		/* cb_data of the request */
+	int ev_error;			/* 0, or an error code */
+	size_t ev_nbytes;		/* bytes transferred */
+};
+
+/* Opcodes for cb_opcode */
+#define IOCB_CMD_PREAD    0      /* like pread */
+#define IOCB_CMD_PWRITE   1      /* like pwrite */
+
+/* Limits */
+#define AIO_MAXEVENTS   256      /* most io_setup will allow */
+#define AIO_MAXIO      4096      /* longer requests transfer this much */
+
+
+#endif /* _KERN_AIO_H_ */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SPAWN_H_
+#define _KERN_SPAWN_H_
+
+/*
+ * Definitions for the spawn() system call.
+ *
+ * spawn(path, argv, actions, nactions) creates a child process that
+ * starts out running PATH with arguments ARGV, like fork followed by
+ * execv in the child, but without copying the parent's address
+ * space first. Before the program is loaded, the child's copy of
+ * the parent's file table is adjusted by running the NACTIONS file
+ * actions in ACTIONS in order. Returns the child's pid. If anything
+ * fails, including loading the program, no child is left behind and
+ * the error comes back from spawn itself.
+ */
+
+
+/* File actions for spawn */
+#define SPAWN_FDCLOSE   0      /* close(sfa_fd) */
+#define SPAWN_FDDUP2    1      /* dup2(sfa_fd, sfa_newfd) */
+#define SPAWN_FDOPEN    2      /* open sfa_path on sfa_fd */
+
+/* Most file actions one spawn call may carry */
+#define SPAWN_MAXACTIONS 16
+
+struct spawn_fdaction {
+	int sfa_op;		/* SPAWN_FD* */
+	int sfa_fd;		/* fd to act on */
+	int sfa_newfd;		/* target fd for SPAWN_FDDUP2 */
+	int sfa_flags;		/* open flags for SPAWN_FDOPEN */
+	int sfa_mode;		/* create mode for SPAWN_FDOPEN */
+	const char *sfa_path;	/* pathname for SPAWN_FDOPEN */
+};
+
+
+#endif /* _KERN_SPAWN_H_ */
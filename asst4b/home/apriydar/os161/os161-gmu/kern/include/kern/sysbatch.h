@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SYSBATCH_H_
+#define _KERN_SYSBATCH_H_
+
+/*
+ * Definitions for syscall_batch().
+ *
+ * syscall_batch(descs, n, flags) runs the N system calls described
+ * by the array DESCS, in order, in a single trap, and returns how
+ * many it ran. Each descriptor gives the call number and its
+ * arguments laid out the way the trap would see them: the first four
+ * words as in registers a0-a3 (so a 64-bit argument takes an aligned
+ * pair), then what would be on the stack. The error code and return
+ * value of each call are written back into its descriptor.
+ *
+ * fork, vfork, execv, _exit, thread_exit and syscall_batch itself
+ * can't be batched; they get EINVAL.
+ */
+
+#define SYSBATCH_NARGS     6     /* argument words per call */
+#define SYSBATCH_MAX     256     /* most calls per batch */
+
+/* Flags for syscall_batch */
+#define SYSBATCH_STOPONERR 1     /* Stop after the first call that fails */
+
+struct syscall_desc {
+	int sd_callno;			/* in: SYS_* number */
+	int sd_error;			/* out: 0, or the error code */
+	int32_t sd_retval;		/* out: return value */
+	int32_t sd_retval2;		/* out: low word of 64-bit results */
+	uint32_t sd_args[SYSBATCH_NARGS]; /* in: arguments */
+};
+
+
+#endif /* _KERN_SYSBATCH_H_ */
@@ -86,7 +86,7 @@
 //#define SYS_sigaltstack 33
 //                              (resource tracking and usage)
 //#define SYS_wait4      34
-//#define SYS_getrusage  35
+#define SYS_getrusage  35
 //                              (resource limits)
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv      52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev     57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -196,6 +196,18 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+#define SYS_futex        121
+#define SYS_spawn        122
+#define SYS_thread_create 123
+#define SYS_thread_exit  124
+#define SYS_thread_join  125
+#define SYS_sendfile     126
+#define SYS_io_setup     127
+#define SYS_io_submit    128
+#define SYS_io_getevents 129
+#define SYS_io_destroy   130
+#define SYS_syscall_batch 131
+#define SYS_vmstat       132
 
 /*CALLEND*/
 
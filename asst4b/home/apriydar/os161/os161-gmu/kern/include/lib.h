@@ -133,6 +133,14 @@ void kheap_nextgeneration(void);
 void kheap_dump(void);
 void kheap_dumpall(void);
 
+/*
+ * Scratch buffers of a page or more that are allocated and freed over
+ * and over. kbuf_free keeps them for reuse instead of giving them
+ * back; pass it the same size given to kbuf_alloc.
+ */
+void *kbuf_alloc(size_t size);
+void kbuf_free(void *buf, size_t size);
+
 /*
  * C string functions.
  *
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * Only compiled in with "options lockstat". With the option off none
+ * of the hooks in the lock, spinlock, and wchan code exist at all.
+ *
+ * Statistics are kept per name, not per object: every lock created
+ * with the name "openfile" adds to the same entry. The name is the
+ * one already given to lock_create/sem_create/cv_create/wchan_create;
+ * spinlocks don't have names of their own and are only counted when
+ * the code that owns them names them with lockstat_spinlock_init
+ * (e.g. the spinlock inside a struct lock carries the lock's name).
+ *
+ * Times are read from the realtime clock (the ltimer device) and kept
+ * in nanoseconds. For wchans "acquires" counts sleeps, the wait time
+ * is time spent asleep, and the max hold is the longest single sleep.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct spinlock;
+
+/* Kinds of things we keep statistics for. */
+#define LOCKSTAT_LOCK		0	/* struct lock */
+#define LOCKSTAT_SPINLOCK	1	/* struct spinlock */
+#define LOCKSTAT_WCHAN		2	/* struct wchan (CVs, semaphores...) */
+
+/* Ways to sort the output of lockstat_print. */
+#define LOCKSTAT_BYACQUIRES	0
+#define LOCKSTAT_BYCONTENDED	1
+#define LOCKSTAT_BYWAIT		2
+#define LOCKSTAT_BYHOLD		3
+
+#define LOCKSTAT_NAMELEN	24	/* names longer than this are cut */
+#define LOCKSTAT_MAX		256	/* number of distinct names tracked */
+
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];	/* name this entry is keyed by */
+	int ls_kind;			/* LOCKSTAT_LOCK etc. */
+	uint32_t ls_acquires;		/* total acquisitions */
+	uint32_t ls_contended;		/* acquisitions that had to wait */
+	uint64_t ls_waitnsec;		/* total time spent waiting */
+	uint64_t ls_maxholdnsec;	/* longest single hold */
+};
+
+/*
+ * Functions:
+ *
+ * lockstat_bootstrap - Start timing. Called once the clock device is
+ *                      attached; before that only the entries exist.
+ * lockstat_get       - Find (or make) the entry for NAME of KIND.
+ *                      Returns NULL if the table is full.
+ * lockstat_now       - Current time in nanoseconds, or 0 if timing
+ *                      isn't on yet.
+ * lockstat_acquired  - Record an acquisition. CONTENDED says whether
+ *                      the caller found the lock busy, and WAITSTART
+ *                      is the time it did so. Returns the acquire
+ *                      time for passing to lockstat_released.
+ * lockstat_released  - Record the end of a hold that began at
+ *                      ACQUIRED.
+ * lockstat_spinlock_init - Name a spinlock so it gets counted.
+ * lockstat_print     - Print everything, sorted by SORTBY.
+ * lockstat_reset     - Zero all the counters.
+ */
+void lockstat_bootstrap(void);
+struct lockstat *lockstat_get(const char *name, int kind);
+uint64_t lockstat_now(void);
+uint64_t lockstat_acquired(struct lockstat *ls, bool contended,
+			   uint64_t waitstart);
+void lockstat_released(struct lockstat *ls, uint64_t acquired);
+void lockstat_spinlock_init(struct spinlock *splk, const char *name);
+void lockstat_print(int sortby);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+
+#endif /* _LOCKSTAT_H_ */
@@ -36,6 +36,9 @@
 
 #include <spinlock.h>
 
+struct uio;
+struct vnode;
+
 
 /*
  * Structure for open files.
@@ -51,6 +54,7 @@
 struct openfile {
 	struct vnode *of_vnode;
 	int of_accmode;	/* from open: O_RDONLY, O_WRONLY, or O_RDWR */
+	volatile int of_flags;	/* O_NONBLOCK, from open or fcntl */
 
 	struct lock *of_offsetlock;	/* lock for of_offset */
 	off_t of_offset;
@@ -63,9 +67,23 @@ struct openfile {
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* make an openfile for an already referenced vnode (consumes it) */
+int openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
 
+/* do I/O at (and advancing) the seek position */
+int openfile_readwrite(struct openfile *file, struct uio *uio);
+
+/* do I/O at the uio's offset, leaving the seek position alone */
+int openfile_preadwrite(struct openfile *file, struct uio *uio);
+
+/* copy between two files through a kernel buffer (for sendfile) */
+#define SENDFILE_BUFSIZE	16384
+int openfile_sendfile(struct openfile *out, struct openfile *in, off_t *pos,
+		      size_t count, size_t *done);
+
 
 #endif /* _OPENFILE_H_ */
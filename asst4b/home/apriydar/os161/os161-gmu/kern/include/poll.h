@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Kernel support for poll().
+ *
+ * Anything that can be polled keeps a pollqueue, and calls
+ * pollqueue_wakeup on it whenever it may have become readable or
+ * writable or hung up. Its vop_poll hands the pollqueue to poller_add
+ * before looking at its state and returns the POLL* bits that are
+ * true now. Because the poller is on the queue before the state is
+ * examined, a change that comes in between is not missed: it wakes
+ * the poller and vfs_poll looks again.
+ *
+ * The poller is NULL when vfs_poll is only checking state again after
+ * a wakeup; poller_add does nothing then.
+ */
+
+#include <kern/poll.h>
+#include <spinlock.h>
+
+struct vnode;
+struct poller;
+struct pollentry;
+
+struct pollqueue {
+	struct spinlock pq_lock;
+	struct pollentry *pq_first;	/* pollers waiting on us */
+};
+
+void pollqueue_init(struct pollqueue *pq);
+void pollqueue_cleanup(struct pollqueue *pq);
+void pollqueue_wakeup(struct pollqueue *pq);
+
+void poller_add(struct poller *pl, struct pollqueue *pq);
+
+/*
+ * Wait until at least one of VNS[0..NFDS-1] is ready as asked for by
+ * FDS[i].events, or TIMEOUT milliseconds pass (never, if negative).
+ * Sets FDS[i].revents and returns in *NREADY how many are nonzero.
+ * An entry whose vnode is NULL keeps whatever revents the caller gave
+ * it, so the caller can report POLLNVAL or skip it with 0. Returns
+ * EINTR if the process starts exiting while it waits.
+ */
+int vfs_poll(struct vnode **vns, struct pollfd *fds, unsigned nfds,
+	     int timeout, unsigned *nready);
+
+/*
+ * Called from hardclock so that pollers with a timeout look at the
+ * time now and then.
+ */
+void poll_tick(void);
+
+
+#endif /* _POLL_H_ */
@@ -47,6 +47,7 @@
 
 struct addrspace;
 struct vnode;
+struct aioctx;
 
 
 
@@ -60,6 +61,24 @@ struct vnode;
 //DEFARRAY(proc, PROCINLINE);
 
 
+/*
+ * Record for a user thread made with thread_create. It stays on its
+ * process's p_uthreads list after the thread exits, holding the exit
+ * status, until another thread joins it or the process goes away.
+ * The process's first thread has no record.
+ */
+struct uthread {
+	int ut_tid;			/* thread id given to userland */
+	struct thread *ut_thread;	/* the thread, once it's running */
+	vaddr_t ut_entry;		/* where it starts in userland */
+	vaddr_t ut_arg;			/* argument passed in a0 */
+	vaddr_t ut_stack;		/* its own user stack */
+	bool ut_exited;			/* has called thread_exit */
+	bool ut_joining;		/* someone is in thread_join on it */
+	int ut_status;			/* value passed to thread_exit */
+	struct uthread *ut_next;
+};
+
 /*
  * Process structure.
  */
@@ -74,18 +93,42 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
+	struct aioctx *p_aio;		/* io_setup context, if any */
 
 	/* proc structure items */
 	int p_pid;
-	struct semaphore *p_sem; //for wait/exit in processes
-	//struct cv* p_cv;
-	//struct lock* p_cv_lock;	
-
+	struct cv *p_waitcv;	/* parent sleeps here in waitpid */
+	bool p_zombie;		/* exited, waiting for parent to reap */
+	bool p_vforked;		/* running in the parent's address space */
 	int p_exitval; //value to return with exit codes
-	bool p_finished; //process can exit if finished = true
 
-	struct array *p_children; //array of pids of child processes 
 	struct proc* p_parent;	//proc parent
+	struct proc *p_children;	/* first child */
+	struct proc *p_sibnext;		/* next child of our parent */
+	struct proc *p_sibprev;		/* previous child of our parent */
+
+	/*
+	 * User threads. p_thrlock and p_thrcv are made by the first
+	 * thread_create, when there's only one thread around to do it.
+	 * Once some thread calls _exit, p_exiting is set and the other
+	 * threads leave the next time they come into the kernel, or on
+	 * their way back out of a wait that _exit breaks (proc_sleep).
+	 */
+	struct lock *p_thrlock;		/* for p_uthreads, p_nexttid */
+	struct cv *p_thrcv;		/* thread_join sleeps here */
+	struct uthread *p_uthreads;	/* threads not yet joined */
+	int p_nexttid;			/* next thread id to give out */
+	volatile bool p_exiting;	/* _exit called; all threads go */
+	int p_exitstatus;		/* the status given to _exit */
+
+	/*
+	 * CPU usage. Live threads keep their own counts in t_usage;
+	 * proc_remthread folds them into p_usage as they leave, and
+	 * proc_wait folds a reaped child's totals into p_childusage.
+	 * Both are protected by p_lock.
+	 */
+	struct cpuusage p_usage;	/* threads that have left */
+	struct cpuusage p_childusage;	/* reaped children */
 };
 
 #ifndef PROCINLINE
@@ -115,14 +158,63 @@ struct proc *proc_create_runprogram(const char *name);
 /* Create a fresh process for use by fork() */
 int proc_fork(struct proc **ret);
 
-/* Destroy a process. */
+/* Destroy a process that never ran or failed to start. */
 void proc_destroy(struct proc *proc);
 
+/* Make CHILD a child of PARENT. */
+void proc_addchild(struct proc *parent, struct proc *child);
+
+/* Exit a process, leaving a zombie for its parent (if any) to reap. */
+void proc_exit(struct proc *proc, int status);
+
+/* Sleep until child PID exits, get its exit status, and reap it. */
+int proc_wait(pid_t pid, int *status);
+
+/*
+ * vfork support. The parent sleeps in proc_vforkwait until the child,
+ * which is borrowing its address space, calls proc_vforkdone (from
+ * execv) or exits.
+ */
+void proc_vforkwait(struct proc *child);
+void proc_vforkdone(struct proc *proc);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
-/* Detach a thread from its process. */
-void proc_remthread(struct thread *t);
+/* Detach a thread from its process. Returns how many threads are left. */
+unsigned proc_remthread(struct thread *t);
+
+/*
+ * Sleeps that _exit can break. A thread waiting for something that
+ * may never come (input, say) sleeps with proc_sleep instead of
+ * wchan_sleep, in the same kind of loop. The first call only
+ * records WC and LK so proc_wakesleepers can find the thread; it lets
+ * go of LK to do that and returns 0 without sleeping, so the caller
+ * has to check its condition again. Later calls sleep, or return
+ * EINTR once the process is exiting. When *SLEEPING got set, call
+ * proc_sleepend after letting go of LK.
+ */
+int proc_sleep(struct wchan *wc, struct spinlock *lk, bool *sleeping);
+void proc_sleepend(void);
+
+/* Wake the threads of PROC in proc_sleep. Called by _exit. */
+void proc_wakesleepers(struct proc *proc);
+
+/*
+ * Get the CPU usage of PROC (its threads, exited and live) into SELF
+ * and of its reaped children into CHILDREN. Either may be null.
+ */
+void proc_getusage(struct proc *proc, struct cpuusage *self,
+		   struct cpuusage *children);
+
+/* Print a line per process with its CPU usage (the "ps" command). */
+void proc_printall(void);
+
+/*
+ * Print the per-region fault counts of process PID, or of all of
+ * them if PID is 0 (the "vmstat" command).
+ */
+void proc_printvmstats(pid_t pid);
 
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
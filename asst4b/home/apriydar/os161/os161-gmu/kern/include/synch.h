@@ -36,6 +36,7 @@
 
 
 #include <spinlock.h>
+#include "opt-lockstat.h"
 
 /*
  * Dijkstra-style semaphore.
@@ -79,6 +80,12 @@ struct lock {
 	struct spinlock lk_spinlock;
 	struct thread volatile* lk_thread; // thread that holds the lock
 	bool lk_locked; //false when unlocked, true when locked 
+	int lk_donated;			/* highest priority among waiters */
+	struct lock *lk_heldnext;	/* next lock held by lk_thread */
+#if OPT_LOCKSTAT
+	struct lockstat *lk_stat;	/* contention statistics */
+	uint64_t lk_acquired;		/* when it was last acquired */
+#endif
         
 };
 
@@ -95,10 +102,18 @@ void lock_destroy(struct lock *);
  *                   false otherwise.
  *
  * These operations must be atomic. You get to write them.
+ *
+ * Locks do priority inheritance: while a thread waits in lock_acquire,
+ * the holder (and whoever holds the lock the holder is waiting for,
+ * and so on) runs at no less than the waiter's priority. The boost is
+ * dropped in lock_release. lock_refresh_priority recomputes a thread's
+ * effective priority from its base priority and the locks it holds;
+ * thread_setpriority uses it.
  */
 void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
+void lock_refresh_priority(struct thread *);
 
 
 /*
@@ -142,5 +157,59 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or a single
+ * writer. Writers are preferred: once a writer is waiting, new
+ * readers block until it has been served, so a steady stream of
+ * readers can't starve writers out.
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+	struct spinlock rw_spinlock;
+	struct wchan *rw_readwchan;	/* readers waiting */
+	struct wchan *rw_writewchan;	/* writers waiting */
+	struct wchan *rw_upgradewchan;	/* upgrader waiting for readers */
+	volatile unsigned rw_readers;	/* # of readers holding the lock */
+	volatile unsigned rw_writers_waiting; /* # of writers asleep */
+	struct thread volatile *rw_writer; /* thread holding it for write */
+	bool rw_upgrading;		/* a reader is waiting to upgrade */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Several threads
+ *                           may hold it for reading at the same time.
+ *    rwlock_release_read  - Free a read hold.
+ *    rwlock_acquire_write - Get the lock for writing. Only one thread
+ *                           may hold it for writing, and no readers.
+ *    rwlock_release_write - Free the write hold.
+ *    rwlock_upgrade       - Turn a read hold into a write hold. Returns
+ *                           true if no writer got in between; returns
+ *                           false if another upgrade was already
+ *                           pending, in which case the read hold was
+ *                           dropped before taking the write hold and
+ *                           the caller must recheck what it read.
+ *    rwlock_downgrade     - Turn a write hold into a read hold without
+ *                           letting a writer in between.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_upgrade(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
 
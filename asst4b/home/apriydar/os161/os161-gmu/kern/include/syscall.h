@@ -47,6 +47,41 @@ void syscall(struct trapframe *tf);
 /* Helper for fork(). You write this. */
 void enter_forked_process(void* tfas, unsigned long unused);
 
+/*
+ * Arguments for a new program, packed into one ARG_MAX buffer in the
+ * layout they'll have on its user stack. execargs_init gets a buffer,
+ * execargs_cleanup gives it back, and execargs_kernel fills it from
+ * kernel strings. See proc_syscalls.c.
+ */
+struct execargs {
+	char *ea_buf;		/* argv slots, then the strings */
+	int ea_argc;		/* number of arguments */
+	size_t ea_len;		/* bytes of ea_buf in use */
+};
+
+int execargs_init(struct execargs *ea);
+void execargs_cleanup(struct execargs *ea);
+int execargs_kernel(struct execargs *ea, int argc, char **argv);
+
+/*
+ * Run program PATH with arguments ARGS in CHILD, a fresh child of the
+ * current process. Used by spawn(). See proc_syscalls.c.
+ */
+struct proc;
+int spawn_program(struct proc *child, char *path, struct execargs *args);
+
+/*
+ * Take the current thread out of its process for good, and the process
+ * with it if it's the last thread. See thread_syscalls.c.
+ */
+__DEAD void uthread_leave(int status);
+
+/* Set up the futex wait buckets. Call once during boot. */
+void futex_bootstrap(void);
+
+/* Wake PROC's threads in futex_wait so they can leave. For _exit. */
+void futex_exiting(struct proc *proc);
+
 /* Enter user mode. Does not return. */
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
@@ -65,17 +100,44 @@ int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
+int sys_pipe(userptr_t fds);
+int sys_sendfile(int outfd, int infd, userptr_t offptr, size_t count,
+		 int *retval);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
+int sys_fcntl(int fd, int cmd, int arg, int *retval);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
 
 int sys_chdir(const_userptr_t path);
 int sys___getcwd(userptr_t buf, size_t buflen, int *retval);
 int sys_getpid(pid_t* ret);
 void sys__exit(int exitcode);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t* retval);
+int sys_getrusage(int who, userptr_t usage);
+int sys_vmstat(userptr_t stats, unsigned nstats, int *retval);
 int sys_fork(struct trapframe* tf, pid_t* retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
+int sys_spawn(const_userptr_t path, userptr_t argv, const_userptr_t actions,
+	      int nactions, pid_t *retval);
 
 int sys_execv(const_userptr_t path, userptr_t argv);
 
+int sys_futex(userptr_t addr, int op, int val, int *retval);
+
+int sys_io_setup(unsigned maxevents);
+int sys_io_submit(int nr, userptr_t iocbpp, int *retval);
+int sys_io_getevents(unsigned min_nr, unsigned nr, userptr_t events,
+		     int *retval);
+int sys_io_destroy(void);
+
+int sys_thread_create(userptr_t entry, userptr_t arg, userptr_t stack,
+		      int *retval);
+__DEAD void sys_thread_exit(int status);
+int sys_thread_join(int tid, userptr_t status);
+
 #endif /* _SYSCALL_H_ */
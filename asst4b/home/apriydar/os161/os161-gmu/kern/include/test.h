@@ -35,6 +35,8 @@
  * functions.
  */
 
+struct proc;
+
 
 /* This is only actually available if OPT_SYNCHPROBS is set. */
 int whalemating(int, char **);
@@ -53,10 +55,25 @@ int threadlisttest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadtest4(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int rwtest(int, char **);
+int priotest(int, char **);
+int proctest(int, char **);
+int proctest2(int, char **);
+struct proc *proctest_hold(void);
+void proctest_release(struct proc *anchor);
+int spawntest(int, char **);
+int filetabletest(int, char **);
+int writevtest(int, char **);
+int pipetest(int, char **);
+int sendfiletest(int, char **);
+int polltest(int, char **);
+int sysbatchtest(int, char **);
+int conwritetest(int, char **);
 
 /* filesystem tests */
 int fstest(int, char **);
@@ -41,6 +41,7 @@
 #include <threadlist.h>
 
 struct cpu;
+struct lock;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -55,6 +56,23 @@ struct cpu;
 /* Macro to test if two addresses are on the same kernel stack */
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
+/* Thread priorities. Larger numbers run first. */
+#define PRI_MIN		0
+#define PRI_DEFAULT	16
+#define PRI_MAX		31
+
+
+/*
+ * CPU usage of a thread, or summed over the threads of a process.
+ * Times are in hardclock ticks (HZ per second).
+ */
+struct cpuusage {
+	unsigned cu_utime;	/* ticks spent in user mode */
+	unsigned cu_stime;	/* ticks spent in the kernel */
+	unsigned cu_nvcsw;	/* voluntary context switches */
+	unsigned cu_nivcsw;	/* involuntary (preempted) switches */
+	unsigned cu_nfaults;	/* VM faults taken */
+};
 
 /* States a thread can be in. */
 typedef enum {
@@ -84,6 +102,40 @@ struct thread {
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
 
+	/*
+	 * Scheduling priority fields.
+	 *
+	 * t_priority is the priority the thread asked for; it only
+	 * changes through thread_setpriority. t_effpriority is what the
+	 * scheduler actually uses, and is raised above t_priority while
+	 * the thread holds a lock some higher-priority thread is waiting
+	 * for. t_waitlock and t_heldlocks let lock_acquire follow chains
+	 * of holders to pass the boost along; they are protected by the
+	 * priority-inheritance spinlock in synch.c.
+	 */
+	int t_priority;			/* Base priority */
+	volatile int t_effpriority;	/* Priority including inheritance */
+	struct lock *t_waitlock;	/* Lock we're blocked on, if any */
+	struct lock *t_heldlocks;	/* Locks we hold (via lk_heldnext) */
+
+	/*
+	 * CPU accounting. hardclock charges each tick to the thread it
+	 * interrupts, as user or system time according to
+	 * t_intrfromuser, which the trap code sets for every
+	 * interrupt. The counts are only changed by the thread itself
+	 * and move into its process when it leaves (proc_remthread).
+	 */
+	struct cpuusage t_usage;
+	bool t_intrfromuser;		/* current interrupt came from usermode */
+
+	/*
+	 * Where the thread sleeps while in a wait that _exit has to be
+	 * able to break (see proc_sleep). Protected by the process's
+	 * p_lock.
+	 */
+	struct wchan *t_intrwchan;
+	struct spinlock *t_intrlock;
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -157,6 +209,24 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Set the base priority of the current thread (PRI_MIN to PRI_MAX).
+ * Any priority currently inherited through held locks is kept.
+ */
+void thread_setpriority(int priority);
+
+/*
+ * Set the effective priority of a thread, moving it within its run
+ * queue if it is waiting to run. For use by the lock code in synch.c,
+ * which must hold its priority-inheritance spinlock.
+ */
+void thread_set_effpriority(struct thread *t, int priority);
+
+/*
+ * Add the counts in CU into SUM.
+ */
+void cpuusage_add(struct cpuusage *sum, const struct cpuusage *cu);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
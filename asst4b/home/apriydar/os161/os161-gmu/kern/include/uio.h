@@ -78,6 +78,7 @@ struct uio {
 	enum uio_seg      uio_segflg;	/* What kind of pointer we have */
 	enum uio_rw       uio_rw;	/* Whether op is a read or write */
 	struct addrspace *uio_space;	/* Address space for user pointer */
+	bool              uio_nonblock;	/* EAGAIN rather than wait (O_NONBLOCK) */
 };
 
 
@@ -96,6 +97,9 @@ struct uio {
  *   (5) if uio_seg is UIO_SYSSPACE, set uio_space to NULL; otherwise,
  *       initialize uio_space to the address space in which the buffer
  *       should be found.
+ *   (6) set uio_nonblock if the object should fail with EAGAIN (or
+ *       stop short) rather than wait for data or room. uio_kinit and
+ *       friends clear it.
  *
  * After calling,
  *   (1) the contents of uio_iov and uio_iovcnt may be altered and
@@ -144,5 +148,15 @@ void uio_kinit(struct iovec *, struct uio *,
 void uio_uinit(struct iovec *, struct uio *,
 	       userptr_t ubuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * Initialize a uio over an array of IOVCNT iovecs that's already been
+ * filled in, for scatter/gather I/O. The residue is the sum of their
+ * lengths; the caller must make sure that doesn't overflow.
+ */
+void uio_kinitv(struct iovec *, unsigned iovcnt, struct uio *,
+		off_t pos, enum uio_rw rw);
+void uio_uinitv(struct iovec *, unsigned iovcnt, struct uio *,
+		off_t pos, enum uio_rw rw);
+
 
 #endif /* _UIO_H_ */
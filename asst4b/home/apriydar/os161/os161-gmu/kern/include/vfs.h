@@ -157,9 +157,20 @@ int vfs_getcwd(struct uio *buf);
  *                    specified device.
  *
  *    vfs_unmountall - Unmount all mounted filesystems.
+ *
+ *    vfs_reclaim_bootstrap - Call once workqueues are running. From
+ *                    then on VOP_RECLAIM for a vnode whose last
+ *                    reference goes away is done by a worker thread
+ *                    rather than by whoever dropped the reference.
+ *
+ *    vfs_reclaim_flush - Wait until all pending deferred reclaims have
+ *                    run. Must not be called with the vfs big lock
+ *                    held, since reclaim takes it.
  */
 
 void vfs_bootstrap(void);
+void vfs_reclaim_bootstrap(void);
+void vfs_reclaim_flush(void);
 
 int vfs_setbootfs(const char *fsname);
 void vfs_clearbootfs(void);
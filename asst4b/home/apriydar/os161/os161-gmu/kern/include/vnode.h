@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct poller;
 
 
 /*
@@ -57,6 +58,8 @@ struct vnode {
 	void *vn_data;                  /* Filesystem-specific data */
 
 	const struct vnode_ops *vn_ops; /* Functions on this vnode */
+
+	volatile uint32_t vn_version;   /* Changes when contents change */
 };
 
 /*
@@ -132,6 +135,12 @@ struct vnode {
  *                      uio. Need not work on objects that are not
  *                      directories.
  *
+ *    vop_poll        - Pass the object's pollqueue to poller_add, then
+ *                      return which of POLLIN, POLLOUT, POLLERR, and
+ *                      POLLHUP hold (see <poll.h>). May be NULL for
+ *                      objects that never block, like regular files;
+ *                      these are always ready for reading and writing.
+ *
  *****************************************
  *
  *    vop_creat       - Create a regular file named NAME in the passed
@@ -196,6 +205,7 @@ struct vnode_ops {
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
 	int (*vop_namefile)(struct vnode *file, struct uio *uio);
+	int (*vop_poll)(struct vnode *object, struct poller *pl);
 
 
 	int (*vop_creat)(struct vnode *dir,
@@ -231,15 +241,16 @@ struct vnode_ops {
 #define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
-#define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
+#define VOP_WRITE(vn, uio)  vnode_changed(vn, __VOP(vn, write)(vn, uio))
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
-#define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
+#define VOP_TRUNCATE(vn, pos) vnode_changed(vn, __VOP(vn,truncate)(vn,pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
+#define VOP_POLL(vn, pl)                vnode_poll(vn, pl)
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
 #define VOP_SYMLINK(vn, name, content)  (__VOP(vn, symlink)(vn, name, content))
@@ -257,6 +268,21 @@ struct vnode_ops {
  */
 void vnode_check(struct vnode *, const char *op);
 
+/*
+ * Content versioning. vn_version is set from a global counter when
+ * the vnode is made and again after every VOP_WRITE and VOP_TRUNCATE,
+ * so anything cached from a file's contents can be checked against
+ * it; no two vnodes (even at the same address, one after the other)
+ * share a version. vnode_changed takes and returns the result of the
+ * operation so it can wrap the call in the VOP_ macros.
+ */
+int vnode_changed(struct vnode *, int result);
+
+/*
+ * VOP_POLL, allowing for a null vop_poll.
+ */
+int vnode_poll(struct vnode *, struct poller *pl);
+
 /*
  * Reference count manipulation (handled above filesystem level)
  */
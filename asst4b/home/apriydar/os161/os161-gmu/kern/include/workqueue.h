@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Deferred work.
+ *
+ * A workqueue collects calls to be made later by a pool of kernel
+ * worker threads, so slow housekeeping (reclaiming vnodes, writing
+ * back inodes) doesn't have to happen in the thread that triggered
+ * it. There is one pool of workers per cpu; work is handed to the
+ * pool of the cpu that enqueues it.
+ *
+ * Each queue has a concurrency limit: no more than MAXACTIVE of its
+ * items are ever running at once, across all the pools. A limit of
+ * 1 makes a queue run its work one item at a time in order.
+ *
+ * The name is for easier debugging. A copy of the name is made
+ * internally.
+ */
+
+struct workqueue;	/* Opaque. */
+
+/* Call once during system startup, after thread_start_cpus. */
+void workqueue_bootstrap(void);
+
+struct workqueue *workqueue_create(const char *name, unsigned maxactive);
+void workqueue_destroy(struct workqueue *wq);
+
+/*
+ * Operations:
+ *    work_enqueue - Arrange for FUNC(DATA1, DATA2) to be called from a
+ *                   worker thread. Returns ENOMEM if the work item
+ *                   can't be allocated, or EAGAIN if the workers
+ *                   aren't running yet; in either case nothing was
+ *                   queued and the caller should do the work itself.
+ *    work_flush   - Wait until everything enqueued on WQ so far (and
+ *                   anything it enqueues on WQ in turn) has run. Must
+ *                   not be called from work running on WQ itself.
+ */
+int work_enqueue(struct workqueue *wq,
+		 void (*func)(void *data1, unsigned long data2),
+		 void *data1, unsigned long data2);
+void work_flush(struct workqueue *wq);
+
+
+#endif /* _WORKQUEUE_H_ */
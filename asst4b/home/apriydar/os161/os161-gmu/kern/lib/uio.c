@@ -162,6 +162,7 @@ uio_kinit(struct iovec *iov, struct uio *u,
 	u->uio_segflg = UIO_SYSSPACE;
 	u->uio_rw = rw;
 	u->uio_space = NULL;
+	u->uio_nonblock = false;
 }
 
 /*
@@ -184,4 +185,46 @@ uio_uinit(struct iovec *iov, struct uio *u,
 	u->uio_segflg = UIO_USERSPACE;
 	u->uio_rw = rw;
 	u->uio_space = proc_getas();
+	u->uio_nonblock = false;
+}
+
+/*
+ * Set up a uio over several iovecs. Common code for uio_kinitv and
+ * uio_uinitv.
+ */
+static
+void
+uio_initv(struct iovec *iov, unsigned iovcnt, struct uio *u,
+	  off_t pos, enum uio_seg seg, enum uio_rw rw)
+{
+	unsigned i;
+
+	DEBUGASSERT(iov != NULL);
+	DEBUGASSERT(u != NULL);
+
+	u->uio_iov = iov;
+	u->uio_iovcnt = iovcnt;
+	u->uio_offset = pos;
+	u->uio_resid = 0;
+	for (i=0; i<iovcnt; i++) {
+		u->uio_resid += iov[i].iov_len;
+	}
+	u->uio_segflg = seg;
+	u->uio_rw = rw;
+	u->uio_space = (seg == UIO_SYSSPACE) ? NULL : proc_getas();
+	u->uio_nonblock = false;
+}
+
+void
+uio_kinitv(struct iovec *iov, unsigned iovcnt, struct uio *u,
+	   off_t pos, enum uio_rw rw)
+{
+	uio_initv(iov, iovcnt, u, pos, UIO_SYSSPACE, rw);
+}
+
+void
+uio_uinitv(struct iovec *iov, unsigned iovcnt, struct uio *u,
+	   off_t pos, enum uio_rw rw)
+{
+	uio_initv(iov, iovcnt, u, pos, UIO_USERSPACE, rw);
 }
@@ -46,9 +46,12 @@
 #include <mainbus.h>
 #include <vfs.h>
 #include <device.h>
+#include <workqueue.h>
+#include <aio.h>
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
+#include <lockstat.h>
 #include "autoconf.h"  // for pseudoconfig
 
 
@@ -111,6 +114,7 @@ boot(void)
 	thread_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	futex_bootstrap();
 	kheap_nextgeneration();
 
 	/* Probe and initialize devices. Interrupts should come on. */
@@ -121,12 +125,19 @@ boot(void)
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
+#if OPT_LOCKSTAT
+	/* The clock exists now, so lock timing can start. */
+	lockstat_bootstrap();
+#endif
 	kheap_nextgeneration();
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	workqueue_bootstrap();
+	vfs_reclaim_bootstrap();
+	aio_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -41,6 +41,7 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -237,6 +238,7 @@ cmd_sync(int nargs, char **args)
 	(void)nargs;
 	(void)args;
 
+	vfs_reclaim_flush();
 	vfs_sync();
 
 	return 0;
@@ -266,6 +268,7 @@ cmd_quit(int nargs, char **args)
 	(void)nargs;
 	(void)args;
 
+	vfs_reclaim_flush();
 	vfs_sync();
 	sys_reboot(RB_POWEROFF);
 	thread_exit();
@@ -392,6 +395,37 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	proc_printall();
+
+	return 0;
+}
+
+static
+int
+cmd_vmstat(int nargs, char **args)
+{
+	pid_t pid = 0;
+
+	if (nargs > 2) {
+		kprintf("Usage: vmstat [pid]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		pid = atoi(args[1]);
+	}
+
+	proc_printvmstats(pid);
+
+	return 0;
+}
+
 static
 int
 cmd_kheapgeneration(int nargs, char **args)
@@ -421,6 +455,42 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKSTAT
+/*
+ * Command for printing lock contention statistics.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int sortby;
+
+	if (nargs == 1 || !strcmp(args[1], "wait")) {
+		sortby = LOCKSTAT_BYWAIT;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "acq")) {
+		sortby = LOCKSTAT_BYACQUIRES;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "cont")) {
+		sortby = LOCKSTAT_BYCONTENDED;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "hold")) {
+		sortby = LOCKSTAT_BYHOLD;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+		return 0;
+	}
+	else {
+		kprintf("Usage: lockstat [wait|acq|cont|hold|reset]\n");
+		return EINVAL;
+	}
+
+	lockstat_print(sortby);
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -488,6 +558,7 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread create/join benchmark  ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -495,6 +566,18 @@ static const char *testmenu[] = {
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
+	"[rwt1] Reader-writer lock test      ",
+	"[pri1] Priority inheritance test     ",
+	"[pt1] Process table benchmark        ",
+	"[pt2] Process fan-out test           ",
+	"[spb] Spawn benchmark                ",
+	"[ftt1] File table test              ",
+	"[wvb] Record writer (writev) bench  ",
+	"[ppb] Pipe test and benchmark       ",
+	"[sfb] Copy (sendfile) benchmark     ",
+	"[plt] Poll and O_NONBLOCK test      ",
+	"[sbb] Syscall batch benchmark       ",
+	"[cwb] Console write benchmark       ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
 	"[fs3] FS write stress               ",
@@ -529,6 +612,11 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[ps] Process CPU usage              ",
+	"[vmstat] Per-region VM fault counts ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -585,6 +673,11 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "ps",         cmd_ps },
+	{ "vmstat",	cmd_vmstat },
+#if OPT_LOCKSTAT
+	{ "lockstat",	cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -600,12 +693,25 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadtest4 },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "rwt1",	rwtest },
+	{ "pri1",	priotest },
+	{ "pt1",	proctest },
+	{ "pt2",	proctest2 },
+	{ "spb",	spawntest },
+	{ "ftt1",	filetabletest },
+	{ "wvb",	writevtest },
+	{ "ppb",	pipetest },
+	{ "sfb",	sendfiletest },
+	{ "plt",	polltest },
+	{ "sbb",	sysbatchtest },
+	{ "cwb",	conwritetest },
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
@@ -44,6 +44,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <limits.h>
 #include <spl.h>
 
 #define PROCINLINE
@@ -53,17 +54,56 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <filetable.h>
+#include <aio.h>
 #include <synch.h>
+#include <wchan.h>
 #include <array.h>
+#include <clock.h>
 
 /* The process for the kernel; this holds all the kernel-only threads.
  */
 struct proc *kproc;
 
-struct lock *p_table_lock;
+/*
+ * The process table is looked up on every waitpid and much more rarely
+ * changed (fork/exit), so it's guarded by a reader-writer lock.
+ */
+struct rwlock *p_table_lock;
 struct semaphore* p_kern_sem;
 
-static struct procarray p_table;
+/*
+ * Pid allocation and lookup.
+ *
+ * Free pids are tracked in a bitmap. The search starts at the word
+ * holding the pid after the last one handed out, so it rotates
+ * through the pid space instead of reusing a just-freed pid at once,
+ * and with any free pids around it ends within a word or two. The
+ * kernel process is pid 0; user processes get PID_MIN to PID_MAX.
+ *
+ * Lookup indexes straight into the table: a small top-level array of
+ * chunks of PID_CHUNK proc pointers, each chunk allocated when its
+ * first pid is handed out, so the whole pid range doesn't cost memory
+ * up front.
+ *
+ * All of this is protected by p_table_lock.
+ */
+#define PID_CHUNK	1024
+#define PID_NCHUNKS	(PID_MAX / PID_CHUNK + 1)
+#define PID_NWORDS	(PID_MAX / 32 + 1)
+
+static uint32_t pid_bitmap[PID_NWORDS];
+static struct proc **pid_table[PID_NCHUNKS];
+static pid_t pid_hint;
+
+static void pid_free(pid_t pid);
+
+/*
+ * Protects the parent/child links (p_parent, p_children) and exit
+ * state (p_zombie, p_exitval) of all processes; parents sleep on the
+ * child's p_waitcv with it held.
+ */
+static struct lock *proc_waitlock;
+
 static int n_pr;
 /*
  * Create a proc structure.
@@ -94,16 +134,39 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
+	proc->p_aio = NULL;
 
 	//init for struct
 
-	proc-> p_sem = sem_create("WaitExitSem",0);
+	proc->p_waitcv = cv_create(proc->p_name);
+	if (proc->p_waitcv == NULL) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
     	proc->p_parent = NULL;
-    	proc->p_children = array_create();
+	proc->p_children = NULL;
+	proc->p_sibnext = NULL;
+	proc->p_sibprev = NULL;
     	proc->p_exitval = 0;
-    	proc->p_finished = false;
+    	proc->p_zombie = false;
+    	proc->p_vforked = false;
+	proc->p_thrlock = NULL;
+	proc->p_thrcv = NULL;
+	proc->p_uthreads = NULL;
+	proc->p_nexttid = 2;	/* the first thread is 1 */
+	proc->p_exiting = false;
+	proc->p_exitstatus = 0;
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_childusage, sizeof(proc->p_childusage));
     
     	newpid = proc_addnew_ptable(proc);
+	if (newpid < 0) {
+		cv_destroy(proc->p_waitcv);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
     	proc->p_pid = newpid;
         //DEBUG(DB_EXEC, "User process with pid %u created.\n",newpid);
 
@@ -112,33 +175,21 @@ proc_create(const char *name)
 }
 
 /*
- * Destroy a proc structure.
- *
- * Note: nothing currently calls this. Your wait/exit code will
- * probably want to do so.
+ * Give up everything a process holds that its parent doesn't need in
+ * order to collect its exit status: asynchronous I/O, current
+ * directory, open files and address space. Called at exit so a
+ * zombie is just its proc structure, and again on destruction for
+ * processes that never ran.
  */
+static
 void
-proc_destroy(struct proc *proc)
+proc_release(struct proc *proc)
 {
-	/*
-	 * You probably want to destroy and null out much of the
-	 * process (particularly the address space) at exit time if
-	 * your wait/exit design calls for the process structure to
-	 * hang around beyond process exit. Some wait/exit designs
-	 * do, some don't.
-	 */
-
-	KASSERT(proc != NULL);
-	KASSERT(proc != kproc);
-	int i,procpid;
-	int* pidkid;
-	struct proc* parent = proc->p_parent;
-	struct proc* kid = NULL;
-	/*
-	 * We don't take p_lock in here because we must have the only
-	 * reference to this structure. (Otherwise it would be
-	 * incorrect to destroy it.)
-	 */
+	/* AIO fields; waits for requests still running */
+	if (proc->p_aio) {
+		aioctx_decref(proc->p_aio);
+		proc->p_aio = NULL;
+	}
 
 	/* VFS fields */
 	if (proc->p_cwd) {
@@ -192,84 +243,379 @@ proc_destroy(struct proc *proc)
 			as_deactivate();
 		}
 		else {
+			/* the vmstat command may be looking at it */
+			spinlock_acquire(&proc->p_lock);
 			as = proc->p_addrspace;
 			proc->p_addrspace = NULL;
+			spinlock_release(&proc->p_lock);
 		}
 		as_destroy(as);
 	}
+}
 
-	threadarray_cleanup(&proc->p_threads);
+static void proc_reap(struct proc *proc);
 
-	kfree(proc->p_name);
-	
-	spinlock_acquire(&proc->p_lock);
-	//if children: 
-	if((int)array_num(proc->p_children) > 0)
-	{
-		for( i=0; i< (int)array_num(proc->p_children); i++)
-		{
-        	
-			pidkid = array_get(proc->p_children, (unsigned)i);
-		
-			kid = proc_get_process((int)pidkid);
-			kid->p_parent = NULL;
-		}
+/*
+ * Link CHILD in at the head of PARENT's list of children.
+ */
+void
+proc_addchild(struct proc *parent, struct proc *child)
+{
+	KASSERT(child->p_parent == NULL);
+
+	lock_acquire(proc_waitlock);
+	child->p_parent = parent;
+	child->p_sibprev = NULL;
+	child->p_sibnext = parent->p_children;
+	if (parent->p_children != NULL) {
+		parent->p_children->p_sibprev = child;
 	}
-	spinlock_release(&proc->p_lock);
-	
-	//if parent exists, remove me from parents children array
-	if(parent != NULL)
-	{
-		spinlock_acquire(&parent->p_lock);
-	        //DEBUG(DB_EXEC, "My siblings: %d \n", array_num(parent->p_children));
-    		for (i = 0; i < (int) array_num(parent->p_children); i++)
-	    	{
-	                pidkid = array_get(parent->p_children, i);
-    			// from all my parent's children, find me
-			if( (int)pidkid == proc->p_pid)
-	        	{//remove me from the list
-	        		array_remove(parent->p_children, i);
-	        		break;
-	    		}
-	    	}
-	    	spinlock_release(&parent->p_lock);
-		
+	parent->p_children = child;
+	lock_release(proc_waitlock);
+}
+
+/*
+ * Take PROC off its parent's list of children. Caller holds
+ * proc_waitlock.
+ */
+static
+void
+proc_unlinkchild(struct proc *proc)
+{
+	struct proc *parent = proc->p_parent;
+
+	KASSERT(parent != NULL);
+
+	if (proc->p_sibprev != NULL) {
+		proc->p_sibprev->p_sibnext = proc->p_sibnext;
 	}
-	procpid= proc->p_pid; // no significance except debugging
-	spinlock_cleanup(&proc->p_lock);
-	
-	if(parent == NULL)
-	{ //destroying everything if parent is also null.
-		sem_destroy(proc->p_sem);
-		lock_acquire(p_table_lock);
-	       	procarray_set(&p_table, proc->p_pid, NULL);
-	       	lock_release(p_table_lock);
-		
-		kfree(proc->p_name);
-		kfree(proc);
+	else {
+		KASSERT(parent->p_children == proc);
+		parent->p_children = proc->p_sibnext;
+	}
+	if (proc->p_sibnext != NULL) {
+		proc->p_sibnext->p_sibprev = proc->p_sibprev;
 	}
+	proc->p_sibnext = NULL;
+	proc->p_sibprev = NULL;
+	proc->p_parent = NULL;
+}
 
-	lock_acquire(p_table_lock);
-	
-    
+/*
+ * Detach PROC's children, all at once. Nobody will wait for them
+ * now, so the ones that have already exited are reaped and the rest
+ * will reap themselves when they exit. Caller holds proc_waitlock.
+ */
+static
+void
+proc_orphankids(struct proc *proc)
+{
+	struct proc *kid, *next;
+
+	KASSERT(lock_do_i_hold(proc_waitlock));
+
+	kid = proc->p_children;
+	proc->p_children = NULL;
+	while (kid != NULL) {
+		next = kid->p_sibnext;
+		kid->p_parent = NULL;
+		kid->p_sibnext = NULL;
+		kid->p_sibprev = NULL;
+		if (kid->p_zombie) {
+			proc_reap(kid);
+		}
+		kid = next;
+	}
+}
+
+/*
+ * Free a proc structure for good: unlink it from its parent, orphan
+ * its children (reaping any that are already zombies, since nobody
+ * is left to wait for them), and drop it from the process table.
+ * Caller holds proc_waitlock.
+ */
+static
+void
+proc_reap(struct proc *proc)
+{
+	KASSERT(lock_do_i_hold(proc_waitlock));
+	KASSERT(proc != kproc);
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
+
+	proc_orphankids(proc);
+
+	if (proc->p_parent != NULL) {
+		proc_unlinkchild(proc);
+	}
+
+	rwlock_acquire_write(p_table_lock);
+	pid_free(proc->p_pid);
 	KASSERT(n_pr > 0);
-	
     	n_pr--; //total processes in the system
-	DEBUG(DB_EXEC, "-npr %u, with process %u gone. arraynum %u\n",n_pr, procpid, procarray_num(&p_table));
+	DEBUG(DB_EXEC, "-npr %u, with process %u gone.\n",n_pr, proc->p_pid);
     	if (n_pr == 1)//if only kernel process left
     	{
-	//remove destroyed processes from ptable
-		
-		for (i = (int) procarray_num(&p_table)-1; i>=1; i--)
-                {
-			procarray_remove(&p_table, i);
-		}
         	V(p_kern_sem);
-	        DEBUG(DB_EXEC, "V pksem %u. arraynum %u\n",p_kern_sem->sem_count, procarray_num(&p_table));
+	        DEBUG(DB_EXEC, "V pksem %u.\n",p_kern_sem->sem_count);
     	}
-    	lock_release(p_table_lock);
+    	rwlock_release_write(p_table_lock);
+
+	/* thread records nobody joined */
+	while (proc->p_uthreads != NULL) {
+		struct uthread *ut = proc->p_uthreads;
+
+		proc->p_uthreads = ut->ut_next;
+		kfree(ut);
+	}
+	if (proc->p_thrlock != NULL) {
+		cv_destroy(proc->p_thrcv);
+		lock_destroy(proc->p_thrlock);
+	}
+
+	cv_destroy(proc->p_waitcv);
+	threadarray_cleanup(&proc->p_threads);
+	spinlock_cleanup(&proc->p_lock);
+	kfree(proc->p_name);
+	kfree(proc);
+}
+
+/*
+ * Destroy a proc structure that never got to exit normally, e.g. one
+ * whose fork failed partway.
+ */
+void
+proc_destroy(struct proc *proc)
+{
+	KASSERT(proc != NULL);
+	KASSERT(proc != kproc);
+
+	proc_release(proc);
+
+	lock_acquire(proc_waitlock);
+	proc_reap(proc);
+	lock_release(proc_waitlock);
+}
+
+/*
+ * Process exit. The calling thread must already have left PROC.
+ * PROC gives up its resources and becomes a zombie holding only its
+ * pid and STATUS until its parent collects it with proc_wait. If
+ * there's no parent to do that, it's reaped right away. Zombie
+ * children of PROC are reaped too, and live ones are orphaned.
+ */
+void
+proc_exit(struct proc *proc, int status)
+{
+	KASSERT(proc != NULL);
+	KASSERT(proc != kproc);
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
+
+	proc_release(proc);
+
+	lock_acquire(proc_waitlock);
+
+	proc_orphankids(proc);
+
+	proc->p_exitval = status;
+	proc->p_zombie = true;
+	proc->p_vforked = false;
+	if (proc->p_parent == NULL) {
+		proc_reap(proc);
+	}
+	else {
+		cv_broadcast(proc->p_waitcv, proc_waitlock);
+	}
+
+	lock_release(proc_waitlock);
+}
+
+/*
+ * Wait for child PID of the current process to exit, sleeping rather
+ * than spinning, and hand back its exit status. The child is reaped.
+ */
+int
+proc_wait(pid_t pid, int *status)
+{
+	struct proc *child;
+
+	lock_acquire(proc_waitlock);
+
+	child = proc_get_process(pid);
+	if (child == NULL || child->p_parent != curproc) {
+		lock_release(proc_waitlock);
+		return ECHILD;
+	}
+
+	while (!child->p_zombie) {
+		cv_wait(child->p_waitcv, proc_waitlock);
+	}
+
+	/* only we (the parent) can reap it, so it's still there */
+	*status = child->p_exitval;
+
+	/* its threads are all gone, so its totals are final */
+	spinlock_acquire(&curproc->p_lock);
+	cpuusage_add(&curproc->p_childusage, &child->p_usage);
+	cpuusage_add(&curproc->p_childusage, &child->p_childusage);
+	spinlock_release(&curproc->p_lock);
+
+	proc_reap(child);
+
+	lock_release(proc_waitlock);
+	return 0;
+}
+
+/*
+ * Sleep until CHILD, which we lent our address space to in vfork,
+ * is done with it. The child can't be reaped out from under us:
+ * we're its parent and we aren't waiting for it or exiting.
+ */
+void
+proc_vforkwait(struct proc *child)
+{
+	lock_acquire(proc_waitlock);
+	KASSERT(child->p_parent == curproc);
+	while (child->p_vforked) {
+		cv_wait(child->p_waitcv, proc_waitlock);
+	}
+	lock_release(proc_waitlock);
+}
+
+/*
+ * A vforked PROC has its own address space now; let the parent go.
+ * (proc_exit does this too.)
+ */
+void
+proc_vforkdone(struct proc *proc)
+{
+	lock_acquire(proc_waitlock);
+	proc->p_vforked = false;
+	cv_broadcast(proc->p_waitcv, proc_waitlock);
+	lock_release(proc_waitlock);
 }
 
+/*
+ * Add up the CPU usage of PROC and/or its reaped children. The
+ * counts of live threads are read without stopping them, so they
+ * can be a tick behind.
+ */
+void
+proc_getusage(struct proc *proc, struct cpuusage *self,
+	      struct cpuusage *children)
+{
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	if (self != NULL) {
+		*self = proc->p_usage;
+		num = threadarray_num(&proc->p_threads);
+		for (i=0; i<num; i++) {
+			cpuusage_add(self,
+			     &threadarray_get(&proc->p_threads, i)->t_usage);
+		}
+	}
+	if (children != NULL) {
+		*children = proc->p_childusage;
+	}
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Print every process with its CPU usage. Holding proc_waitlock keeps
+ * processes from being reaped (and the parent links from changing)
+ * while we look at them.
+ */
+void
+proc_printall(void)
+{
+	struct proc **chunk;
+	struct proc *p;
+	struct cpuusage cu;
+	unsigned c, i, nthreads;
+
+	kprintf("  PID  PPID S THR  USER(ms)   SYS(ms)    VCSW   IVCSW "
+		" FAULTS NAME\n");
+
+	lock_acquire(proc_waitlock);
+	rwlock_acquire_read(p_table_lock);
+	for (c=0; c<PID_NCHUNKS; c++) {
+		chunk = pid_table[c];
+		if (chunk == NULL) {
+			continue;
+		}
+		for (i=0; i<PID_CHUNK; i++) {
+			p = chunk[i];
+			if (p == NULL) {
+				continue;
+			}
+			proc_getusage(p, &cu, NULL);
+			spinlock_acquire(&p->p_lock);
+			nthreads = threadarray_num(&p->p_threads);
+			spinlock_release(&p->p_lock);
+
+			kprintf("%5d %5d %c %3u %9u %9u %7u %7u %7u %s\n",
+				p->p_pid,
+				p->p_parent ? p->p_parent->p_pid : 0,
+				p->p_zombie ? 'Z' : 'R',
+				nthreads,
+				cu.cu_utime * 1000 / HZ,
+				cu.cu_stime * 1000 / HZ,
+				cu.cu_nvcsw, cu.cu_nivcsw, cu.cu_nfaults,
+				p->p_name);
+		}
+	}
+	rwlock_release_read(p_table_lock);
+	lock_release(proc_waitlock);
+}
+
+/*
+ * Print the fault counts for each region of process PID's address
+ * space, or of every process's if PID is 0.
+ */
+void
+proc_printvmstats(pid_t pid)
+{
+	static const char *const regionnames[VMSTAT_MAXREGIONS] = {
+		"region1", "region2", "stack",
+	};
+	struct vmregionstat vs[VMSTAT_MAXREGIONS];
+	struct proc **chunk;
+	struct proc *p;
+	unsigned c, i, j, n;
+
+	kprintf("  PID REGION       VBASE PAGES 1STTOUCH  REFILLS READONLY"
+		" NAME\n");
+
+	rwlock_acquire_read(p_table_lock);
+	for (c=0; c<PID_NCHUNKS; c++) {
+		chunk = pid_table[c];
+		if (chunk == NULL) {
+			continue;
+		}
+		for (i=0; i<PID_CHUNK; i++) {
+			p = chunk[i];
+			if (p == NULL || (pid != 0 && p->p_pid != pid)) {
+				continue;
+			}
+			/* p_lock keeps the address space from going away */
+			spinlock_acquire(&p->p_lock);
+			n = p->p_addrspace == NULL ? 0 :
+				as_getstats(p->p_addrspace, vs,
+					    VMSTAT_MAXREGIONS);
+			spinlock_release(&p->p_lock);
+
+			for (j=0; j<n && j<VMSTAT_MAXREGIONS; j++) {
+				kprintf("%5d %-8s 0x%08x %5u %8u %8u %8u %s\n",
+					p->p_pid, regionnames[j],
+					vs[j].vr_vbase, vs[j].vr_npages,
+					vs[j].vr_firsttouch,
+					vs[j].vr_tlbrefills,
+					vs[j].vr_readonly, p->p_name);
+			}
+		}
+	}
+	rwlock_release_read(p_table_lock);
+}
 
 /*
  * Create the process structure for the kernel.
@@ -277,12 +623,17 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+	int i;
+
 	//global initialisations
-	procarray_init(&p_table);
-	p_table_lock = lock_create("ProcessTableLock");
+	p_table_lock = rwlock_create("ProcessTableLock");
 	
 	if(p_table_lock == NULL)
 	    panic("p_table_lock creation failed");
+	proc_waitlock = lock_create("proc_waitlock");
+	if (proc_waitlock == NULL) {
+		panic("proc_waitlock creation failed\n");
+	}
         p_kern_sem = sem_create("WaitingKernelSem",0);
         if(p_kern_sem == NULL)
         {
@@ -291,6 +642,12 @@ proc_bootstrap(void)
 
         n_pr =0;
 
+	/* pids below PID_MIN other than the kernel's are never handed out */
+	for (i=0; i<PID_MIN; i++) {
+		pid_bitmap[i / 32] |= (uint32_t)1 << (i % 32);
+	}
+	pid_hint = PID_MIN;
+
 	kproc = proc_create("kernel");
 	if(kproc == NULL) {
 	    panic("proc_create for kproc failed\n");
@@ -419,14 +776,15 @@ proc_addthread(struct proc *proc, struct thread *t)
 
 /*
  * Remove a thread from its process. Either the thread or the process
- * might or might not be current.
+ * might or might not be current. Returns the number of threads left,
+ * so exactly one caller sees the process become empty.
  *
  * Turn off interrupts on the local cpu while changing t_proc, in
  * case it's current, to protect against the as_activate call in
  * the timer interrupt context switch, and any other implicit uses
  * of "curproc".
  */
-void
+unsigned
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
@@ -442,26 +800,98 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			cpuusage_add(&proc->p_usage, &t->t_usage);
+			bzero(&t->t_usage, sizeof(t->t_usage));
 			spinlock_release(&proc->p_lock);
 			spl = splhigh();
 			t->t_proc = NULL;
 			splx(spl);
-			return;
+			return num - 1;
 		}
 	}
 	/* Did not find it. */
 	spinlock_release(&proc->p_lock);
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 	}
+	return 0;
+}
+
+/*
+ * Interruptible sleep; see proc.h.
+ *
+ * Recording the sleep takes p_lock, and proc_wakesleepers takes LK
+ * while holding p_lock, so LK has to be let go of here. Because
+ * p_exiting is set before proc_wakesleepers looks, a thread that
+ * gets recorded too late to be woken sees it on the next call.
+ * Holding p_lock across the wakeup also keeps the wchan from going
+ * away under it: the sleeper can't get out of proc_sleepend, and so
+ * can't drop whatever holds the wchan, until it's done.
+ */
+int
+proc_sleep(struct wchan *wc, struct spinlock *lk, bool *sleeping)
+{
+	struct proc *proc = curproc;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	if (!*sleeping) {
+		spinlock_release(lk);
+		spinlock_acquire(&proc->p_lock);
+		KASSERT(curthread->t_intrwchan == NULL);
+		curthread->t_intrwchan = wc;
+		curthread->t_intrlock = lk;
+		spinlock_release(&proc->p_lock);
+		spinlock_acquire(lk);
+		*sleeping = true;
+		return 0;
+	}
+
+	KASSERT(curthread->t_intrwchan == wc);
+	if (proc->p_exiting) {
+		return EINTR;
+	}
+	wchan_sleep(wc, lk);
+	return 0;
+}
+
+void
+proc_sleepend(void)
+{
+	struct proc *proc = curproc;
+
+	spinlock_acquire(&proc->p_lock);
+	curthread->t_intrwchan = NULL;
+	curthread->t_intrlock = NULL;
+	spinlock_release(&proc->p_lock);
+}
+
+void
+proc_wakesleepers(struct proc *proc)
+{
+	struct thread *t;
+	unsigned i, num;
+
+	KASSERT(proc->p_exiting);
+
+	spinlock_acquire(&proc->p_lock);
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		if (t->t_intrwchan != NULL) {
+			spinlock_acquire(t->t_intrlock);
+			wchan_wakeall(t->t_intrwchan, t->t_intrlock);
+			spinlock_release(t->t_intrlock);
+		}
+	}
+	spinlock_release(&proc->p_lock);
 }
 
 /*
  * Fetch the address space of (the current) process.
  *
- * Caution: address spaces aren't refcounted. If you implement
- * multithreaded processes, make sure to set up a refcount scheme or
- * some other method to make this safe. Otherwise the returned address
- * space might disappear under you.
+ * Caution: address spaces aren't refcounted. The threads of a process
+ * share it, and it's only destroyed once the last of them has left
+ * (see uthread_leave), so it's safe to use from one of them.
  */
 struct addrspace *
 proc_getas(void)
@@ -500,69 +930,146 @@ proc_setas(struct addrspace *newas)
 
 
 
+/*
+ * Look up a process by pid. Returns NULL if there is no such process.
+ */
 struct proc
 *proc_get_process(int pid)
 {
-	struct proc* p = NULL;
-	lock_acquire(p_table_lock);
-	for (int i=0; i<(int)procarray_num(&p_table); i++)
-	{
-		p = procarray_get(&p_table,(unsigned)i);
-		if (p->p_pid == pid)
-			break;
+	struct proc **chunk;
+	struct proc *found = NULL;
+
+	if (pid < 0 || pid > PID_MAX) {
+		return NULL;
+	}
+
+	rwlock_acquire_read(p_table_lock);
+	chunk = pid_table[pid / PID_CHUNK];
+	if (chunk != NULL) {
+		found = chunk[pid % PID_CHUNK];
 	}
-	lock_release(p_table_lock);
-	return p;
+	rwlock_release_read(p_table_lock);
+	return found;
 }
 
+/*
+ * Record PROC under PID, allocating the table chunk if need be.
+ * Caller holds p_table_lock for writing.
+ */
+static
+int
+pid_install(pid_t pid, struct proc *proc)
+{
+	struct proc **chunk;
+	unsigned i;
 
+	chunk = pid_table[pid / PID_CHUNK];
+	if (chunk == NULL) {
+		chunk = kmalloc(PID_CHUNK * sizeof(*chunk));
+		if (chunk == NULL) {
+			return ENOMEM;
+		}
+		for (i=0; i<PID_CHUNK; i++) {
+			chunk[i] = NULL;
+		}
+		pid_table[pid / PID_CHUNK] = chunk;
+	}
+	chunk[pid % PID_CHUNK] = proc;
+	pid_bitmap[pid / 32] |= (uint32_t)1 << (pid % 32);
+	return 0;
+}
 
+/*
+ * Find a free user pid, starting at pid_hint. Returns -1 if every pid
+ * is in use. Caller holds p_table_lock for writing.
+ *
+ * The first pass over the hint's word ignores the bits below the
+ * hint, so pids are handed out in rotation; they are looked at again
+ * when the search wraps back around to that word at the end.
+ */
+static
+pid_t
+pid_find(void)
+{
+	unsigned w, i, bit;
+	uint32_t bits;
+	pid_t pid;
+
+	w = pid_hint / 32;
+	for (i=0; i<=PID_NWORDS; i++, w = (w + 1) % PID_NWORDS) {
+		bits = pid_bitmap[w];
+		if (i == 0) {
+			bits |= ((uint32_t)1 << (pid_hint % 32)) - 1;
+		}
+		if (bits == 0xffffffff) {
+			continue;
+		}
+		for (bit=0; bit<32; bit++) {
+			if ((bits & ((uint32_t)1 << bit)) == 0) {
+				pid = w * 32 + bit;
+				if (pid >= PID_MIN && pid <= PID_MAX) {
+					return pid;
+				}
+			}
+		}
+	}
+	return -1;
+}
+
+/*
+ * Release PID. Caller holds p_table_lock for writing. The table chunk
+ * stays around for the next process in its range.
+ */
+static
+void
+pid_free(pid_t pid)
+{
+	KASSERT(pid >= 0 && pid <= PID_MAX);
+	KASSERT(pid_table[pid / PID_CHUNK] != NULL);
+
+	pid_table[pid / PID_CHUNK][pid % PID_CHUNK] = NULL;
+	if (pid != 0) {
+		pid_bitmap[pid / 32] &= ~((uint32_t)1 << (pid % 32));
+	}
+}
+
+/*
+ * Give PROC a pid and enter it in the process table. The first
+ * process created (the kernel's) gets pid 0. Returns the pid, or -1
+ * if no pid or no memory is available.
+ */
 int proc_addnew_ptable(struct  proc *proc)
 {
-	//(void)proc;
-	int in;
-	int i;
-	unsigned ret=0;
-	
-	DEBUG(DB_EXEC, "+npr %u, array num %u\n", n_pr, procarray_num(&p_table));
+	pid_t pid;
+	int result;
+
+	DEBUG(DB_EXEC, "+npr %u\n", n_pr);
 	if(n_pr==0)
 	{
-		//lock_acquire(p_table_lock);
-		procarray_add(&p_table, proc, &ret);
-		in = (int) ret;
+		/* kernel process, during bootstrap */
+		result = pid_install(0, proc);
+		if (result) {
+			return -1;
+		}
 		n_pr++;
-		//lock_release(p_table_lock);
-		return in;
+		return 0;
 	}
 
-	else
-	{
-		//user process
-		lock_acquire(p_table_lock);
-		for (i=1; i< (int)procarray_num(&p_table); i++)
-		{
-			struct proc* p=procarray_get(&p_table, i);
-			if(p == NULL)
-			{
-				in=i;
-				procarray_set(&p_table, in, proc);
-				n_pr++;
-				lock_release(p_table_lock);
-				return in;
-			}
-		}
-		//no space found
-		if((int)procarray_num(&p_table) == n_pr) // increase size if table is full
-		{
-			int res= procarray_setsize(&p_table, n_pr+1);
-			KASSERT(res == 0);
-		}
-		in = n_pr; //put process at next index
-		n_pr++;
-		procarray_set(&p_table, in, proc);
-		lock_release(p_table_lock);
-	}	
+	//user process
+	rwlock_acquire_write(p_table_lock);
+	pid = pid_find();
+	if (pid < 0) {
+		rwlock_release_write(p_table_lock);
+		return -1;
+	}
+	result = pid_install(pid, proc);
+	if (result) {
+		rwlock_release_write(p_table_lock);
+		return -1;
+	}
+	pid_hint = (pid == PID_MAX) ? PID_MIN : pid + 1;
+	n_pr++;
+	rwlock_release_write(p_table_lock);
 
-	return in;	
+	return pid;
 }
-
@@ -0,0 +1,509 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous I/O.
+ *
+ * A process's context (p_aio) holds a ring of finished requests.
+ * io_submit copies each request in, takes its own reference to the
+ * open file, and hands it to aio_wq, whose worker threads do the
+ * pread or pwrite with openfile_preadwrite and put it on the ring.
+ * io_getevents takes requests off the ring and reports them.
+ *
+ * The workers belong to the kernel process, not the one that asked,
+ * so they can't touch its memory. Instead each request has a kernel
+ * bounce buffer: a write's data is copied in when it's submitted,
+ * and a read's is copied out when its event is collected, back in
+ * the process that owns the buffer.
+ *
+ * ac_outstanding counts requests from submission to collection and
+ * never exceeds the ring size, so the ring can't overflow. The ring
+ * positions are free-running like the pipe's.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/aio.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <uio.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <workqueue.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <aio.h>
+#include <syscall.h>
+
+/* How many requests the workers run at once, over all processes. */
+#define AIO_MAXACTIVE	4
+
+struct aioreq {
+	struct aioctx *ar_ctx;		/* whose it is */
+	struct openfile *ar_file;	/* our own reference */
+	int ar_opcode;			/* IOCB_CMD_* */
+	userptr_t ar_ubuf;		/* the user's buffer */
+	off_t ar_offset;
+	size_t ar_len;			/* at most AIO_MAXIO */
+	unsigned long ar_data;		/* cb_data */
+	char *ar_buf;			/* bounce buffer */
+	int ar_error;			/* results, set by the worker */
+	size_t ar_done;
+};
+
+struct aioctx {
+	struct lock *ac_lock;		/* for everything below */
+	struct cv *ac_cv;		/* broadcast as requests finish */
+	unsigned ac_refcount;		/* under the owner's p_lock */
+	unsigned ac_max;		/* ring size (maxevents) */
+	unsigned ac_outstanding;	/* submitted, not yet collected */
+	unsigned ac_head;		/* total finished */
+	unsigned ac_tail;		/* total collected */
+	struct aioreq **ac_ring;
+};
+
+static struct workqueue *aio_wq;
+
+void
+aio_bootstrap(void)
+{
+	aio_wq = workqueue_create("aio", AIO_MAXACTIVE);
+	if (aio_wq == NULL) {
+		panic("aio_bootstrap: Out of memory\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+// requests
+
+static
+void
+aioreq_destroy(struct aioreq *req)
+{
+	openfile_decref(req->ar_file);
+	kbuf_free(req->ar_buf, AIO_MAXIO);
+	kfree(req);
+}
+
+/*
+ * Work function: do the I/O and put the request on the ring.
+ */
+static
+void
+aioreq_run(void *vreq, unsigned long junk)
+{
+	struct aioreq *req = vreq;
+	struct aioctx *ctx = req->ar_ctx;
+	struct iovec iov;
+	struct uio ku;
+
+	(void)junk;
+
+	uio_kinit(&iov, &ku, req->ar_buf, req->ar_len, req->ar_offset,
+		  req->ar_opcode == IOCB_CMD_PREAD ? UIO_READ : UIO_WRITE);
+	req->ar_error = openfile_preadwrite(req->ar_file, &ku);
+	req->ar_done = req->ar_len - ku.uio_resid;
+
+	lock_acquire(ctx->ac_lock);
+	KASSERT(ctx->ac_head - ctx->ac_tail < ctx->ac_max);
+	ctx->ac_ring[ctx->ac_head % ctx->ac_max] = req;
+	ctx->ac_head++;
+	cv_broadcast(ctx->ac_cv, ctx->ac_lock);
+	lock_release(ctx->ac_lock);
+}
+
+/*
+ * Start one request. On failure nothing is left behind.
+ */
+static
+int
+aioreq_submit(struct aioctx *ctx, const struct iocb *cb)
+{
+	struct aioreq *req;
+	struct openfile *file;
+	int result;
+
+	if (cb->cb_opcode != IOCB_CMD_PREAD &&
+	    cb->cb_opcode != IOCB_CMD_PWRITE) {
+		return EINVAL;
+	}
+
+	lock_acquire(ctx->ac_lock);
+	if (ctx->ac_outstanding == ctx->ac_max) {
+		lock_release(ctx->ac_lock);
+		return EAGAIN;
+	}
+	ctx->ac_outstanding++;
+	lock_release(ctx->ac_lock);
+
+	req = kmalloc(sizeof(*req));
+	if (req == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+	req->ar_buf = kbuf_alloc(AIO_MAXIO);
+	if (req->ar_buf == NULL) {
+		kfree(req);
+		result = ENOMEM;
+		goto fail;
+	}
+	req->ar_ctx = ctx;
+	req->ar_opcode = cb->cb_opcode;
+	req->ar_ubuf = cb->cb_ubuf;
+	req->ar_offset = cb->cb_offset;
+	req->ar_len = cb->cb_nbytes < AIO_MAXIO ? cb->cb_nbytes : AIO_MAXIO;
+	req->ar_data = cb->cb_data;
+	req->ar_error = 0;
+	req->ar_done = 0;
+
+	if (req->ar_opcode == IOCB_CMD_PWRITE) {
+		result = copyin(req->ar_ubuf, req->ar_buf, req->ar_len);
+		if (result) {
+			goto fail_req;
+		}
+	}
+
+	result = filetable_get(curproc->p_filetable, cb->cb_fd, &file);
+	if (result) {
+		goto fail_req;
+	}
+	openfile_incref(file);
+	filetable_put(curproc->p_filetable, cb->cb_fd, file);
+	req->ar_file = file;
+
+	if (work_enqueue(aio_wq, aioreq_run, req, 0)) {
+		/* no workers to be had; do it now */
+		aioreq_run(req, 0);
+	}
+	return 0;
+
+ fail_req:
+	kbuf_free(req->ar_buf, AIO_MAXIO);
+	kfree(req);
+ fail:
+	lock_acquire(ctx->ac_lock);
+	ctx->ac_outstanding--;
+	lock_release(ctx->ac_lock);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// contexts
+
+static
+struct aioctx *
+aioctx_create(unsigned maxevents)
+{
+	struct aioctx *ctx;
+
+	ctx = kmalloc(sizeof(*ctx));
+	if (ctx == NULL) {
+		return NULL;
+	}
+	ctx->ac_ring = kmalloc(maxevents * sizeof(*ctx->ac_ring));
+	if (ctx->ac_ring == NULL) {
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ac_lock = lock_create("aio");
+	if (ctx->ac_lock == NULL) {
+		kfree(ctx->ac_ring);
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ac_cv = cv_create("aio");
+	if (ctx->ac_cv == NULL) {
+		lock_destroy(ctx->ac_lock);
+		kfree(ctx->ac_ring);
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ac_refcount = 1;
+	ctx->ac_max = maxevents;
+	ctx->ac_outstanding = 0;
+	ctx->ac_head = ctx->ac_tail = 0;
+	return ctx;
+}
+
+/*
+ * Wait for the workers to finish everything, then throw it all away.
+ */
+static
+void
+aioctx_destroy(struct aioctx *ctx)
+{
+	lock_acquire(ctx->ac_lock);
+	while (ctx->ac_head - ctx->ac_tail < ctx->ac_outstanding) {
+		cv_wait(ctx->ac_cv, ctx->ac_lock);
+	}
+	lock_release(ctx->ac_lock);
+
+	while (ctx->ac_tail != ctx->ac_head) {
+		aioreq_destroy(ctx->ac_ring[ctx->ac_tail % ctx->ac_max]);
+		ctx->ac_tail++;
+	}
+
+	cv_destroy(ctx->ac_cv);
+	lock_destroy(ctx->ac_lock);
+	kfree(ctx->ac_ring);
+	kfree(ctx);
+}
+
+/*
+ * Get a reference to the current process's context, so another
+ * thread calling io_destroy can't free it out from under us.
+ */
+static
+struct aioctx *
+aioctx_get(void)
+{
+	struct aioctx *ctx;
+
+	spinlock_acquire(&curproc->p_lock);
+	ctx = curproc->p_aio;
+	if (ctx != NULL) {
+		ctx->ac_refcount++;
+	}
+	spinlock_release(&curproc->p_lock);
+	return ctx;
+}
+
+/*
+ * Drop a reference taken by aioctx_get or held by the process. The
+ * count is only ever touched by threads of the owning process (or by
+ * whoever is tearing it down, when there are none), so the current
+ * process's p_lock protects it.
+ */
+void
+aioctx_decref(struct aioctx *ctx)
+{
+	bool last;
+
+	spinlock_acquire(&curproc->p_lock);
+	KASSERT(ctx->ac_refcount > 0);
+	ctx->ac_refcount--;
+	last = ctx->ac_refcount == 0;
+	spinlock_release(&curproc->p_lock);
+
+	if (last) {
+		aioctx_destroy(ctx);
+	}
+}
+
+/*
+ * Detach the current process's context. Threads that got a reference
+ * with aioctx_get keep it alive until they're done with it.
+ */
+bool
+aioctx_detach(void)
+{
+	struct aioctx *ctx;
+
+	spinlock_acquire(&curproc->p_lock);
+	ctx = curproc->p_aio;
+	curproc->p_aio = NULL;
+	spinlock_release(&curproc->p_lock);
+
+	if (ctx == NULL) {
+		return false;
+	}
+	aioctx_decref(ctx);
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+// system calls
+
+/*
+ * io_setup() - make the process's context. There can only be one.
+ */
+int
+sys_io_setup(unsigned maxevents)
+{
+	struct aioctx *ctx;
+	bool had;
+
+	if (maxevents == 0 || maxevents > AIO_MAXEVENTS) {
+		return EINVAL;
+	}
+
+	ctx = aioctx_create(maxevents);
+	if (ctx == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&curproc->p_lock);
+	had = curproc->p_aio != NULL;
+	if (!had) {
+		curproc->p_aio = ctx;
+	}
+	spinlock_release(&curproc->p_lock);
+
+	if (had) {
+		aioctx_destroy(ctx);
+		return EEXIST;
+	}
+	return 0;
+}
+
+/*
+ * io_destroy() - wait for outstanding requests and drop the context.
+ */
+int
+sys_io_destroy(void)
+{
+	return aioctx_detach() ? 0 : EINVAL;
+}
+
+
+/*
+ * io_submit() - start NR requests. Like a short write, if some were
+ * started before one failed, that's how many we report; the error is
+ * only returned if none were.
+ */
+int
+sys_io_submit(int nr, userptr_t iocbpp, int *retval)
+{
+	struct aioctx *ctx;
+	userptr_t ucb;
+	struct iocb cb;
+	int i, result;
+
+	if (nr < 0) {
+		return EINVAL;
+	}
+	ctx = aioctx_get();
+	if (ctx == NULL) {
+		return EINVAL;
+	}
+
+	result = 0;
+	for (i=0; i<nr; i++) {
+		result = copyin(iocbpp + i * sizeof(ucb), &ucb, sizeof(ucb));
+		if (result) {
+			break;
+		}
+		result = copyin(ucb, &cb, sizeof(cb));
+		if (result) {
+			break;
+		}
+		result = aioreq_submit(ctx, &cb);
+		if (result) {
+			break;
+		}
+	}
+
+	aioctx_decref(ctx);
+	if (i == 0 && result) {
+		return result;
+	}
+	*retval = i;
+	return 0;
+}
+
+/*
+ * io_getevents() - wait for MIN_NR finished requests and collect up
+ * to NR. Asking to wait for more than are outstanding is EINVAL,
+ * since it could never finish. Read data is copied out here.
+ *
+ * A request only comes off the ring once its event has been copied
+ * out, so a bad EVENTS pointer doesn't lose completions; ac_lock
+ * keeps other callers off it meanwhile.
+ */
+int
+sys_io_getevents(unsigned min_nr, unsigned nr, userptr_t events,
+		 int *retval)
+{
+	struct aioctx *ctx;
+	struct aioreq *req;
+	struct io_event ev;
+	unsigned i;
+	int result;
+
+	if (min_nr > nr) {
+		return EINVAL;
+	}
+	ctx = aioctx_get();
+	if (ctx == NULL) {
+		return EINVAL;
+	}
+
+	lock_acquire(ctx->ac_lock);
+	if (min_nr > ctx->ac_outstanding) {
+		lock_release(ctx->ac_lock);
+		aioctx_decref(ctx);
+		return EINVAL;
+	}
+	while (ctx->ac_head - ctx->ac_tail < min_nr) {
+		cv_wait(ctx->ac_cv, ctx->ac_lock);
+	}
+	lock_release(ctx->ac_lock);
+
+	result = 0;
+	for (i=0; i<nr; i++) {
+		lock_acquire(ctx->ac_lock);
+		if (ctx->ac_tail == ctx->ac_head) {
+			lock_release(ctx->ac_lock);
+			break;
+		}
+		req = ctx->ac_ring[ctx->ac_tail % ctx->ac_max];
+
+		ev.ev_data = req->ar_data;
+		ev.ev_error = req->ar_error;
+		ev.ev_nbytes = req->ar_done;
+		if (req->ar_opcode == IOCB_CMD_PREAD && req->ar_done > 0) {
+			result = copyout(req->ar_buf, req->ar_ubuf,
+					 req->ar_done);
+			if (result) {
+				ev.ev_error = result;
+				ev.ev_nbytes = 0;
+			}
+		}
+
+		result = copyout(&ev, events + i * sizeof(ev), sizeof(ev));
+		if (result) {
+			lock_release(ctx->ac_lock);
+			break;
+		}
+		ctx->ac_tail++;
+		ctx->ac_outstanding--;
+		lock_release(ctx->ac_lock);
+
+		aioreq_destroy(req);
+	}
+
+	aioctx_decref(ctx);
+	if (i == 0 && result) {
+		return result;
+	}
+	*retval = i;
+	return 0;
+}
@@ -35,8 +35,10 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <kern/limits.h>
+#include <kern/poll.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
 #include <proc.h>
@@ -47,6 +49,8 @@
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
+#include <poll.h>
 #include <syscall.h>
 
 /*
@@ -57,7 +61,8 @@ int
 sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 {
 	const int allflags =
-		O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND | O_NOCTTY;
+		O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND | O_NOCTTY |
+		O_NONBLOCK;
 
 	char *kpath;
 	struct openfile *file;
@@ -105,20 +110,18 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for read, write, readv, writev, pread and pwrite.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use openfile_readwrite to do the I/O at the
+ * file's seek position, or for the positional calls (POSITIONAL set)
+ * openfile_preadwrite to do it at the uio's offset.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_readwrite(int fd, struct uio *useruio, bool positional, ssize_t *retval)
 {
 	struct openfile *file;
-	bool locked;
-	off_t pos;
-	struct iovec iov;
-	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -127,72 +130,359 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		return result;
 	}
 
-	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
-		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+	size = useruio->uio_resid;
+	result = positional ?
+		openfile_preadwrite(file, useruio) :
+		openfile_readwrite(file, useruio);
+	filetable_put(curproc->p_filetable, fd, file);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * The amount read (or written) is the original buffer size,
+	 * minus how much is left in it.
+	 */
+	*retval = size - useruio->uio_resid;
+	return 0;
+}
+
+/*
+ * read() - use sys_readwrite
+ */
+int
+sys_read(int fd, userptr_t buf, size_t size, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, 0, UIO_READ);
+	return sys_readwrite(fd, &useruio, false, retval);
+}
+
+/*
+ * write() - use sys_readwrite
+ */
+int
+sys_write(int fd, userptr_t buf, size_t size, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, 0, UIO_WRITE);
+	return sys_readwrite(fd, &useruio, false, retval);
+}
+
+/*
+ * pread() - use sys_readwrite, at a given offset
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, pos, UIO_READ);
+	return sys_readwrite(fd, &useruio, true, retval);
+}
+
+/*
+ * pwrite() - use sys_readwrite, at a given offset
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, pos, UIO_WRITE);
+	return sys_readwrite(fd, &useruio, true, retval);
+}
+
+/*
+ * Number of iovecs readv/writev keep on the stack; longer vectors get
+ * copied into a kmalloc'd array.
+ */
+#define SMALL_IOVCNT	8
+
+/*
+ * Common logic for readv and writev: copy in the user's iovec array,
+ * all at once, and hand the lot to sys_readwrite as one uio.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int *retval)
+{
+	struct iovec smalliov[SMALL_IOVCNT], *iov;
+	struct uio useruio;
+	size_t total;
+	int i, result;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= SMALL_IOVCNT) {
+		iov = smalliov;
 	}
 	else {
-		pos = 0;
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
 	}
 
-	if (file->of_accmode == badaccmode) {
-		result = EBADF;
-		goto fail;
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		goto out;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	/* the total has to fit in the (signed) return value */
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > (size_t)-1 / 2 - total) {
+			result = EINVAL;
+			goto out;
+		}
+		total += iov[i].iov_len;
+	}
 
-	/* do the read or write */
-	result = (rw == UIO_READ) ?
-		VOP_READ(file->of_vnode, &useruio) :
-		VOP_WRITE(file->of_vnode, &useruio);
-	if (result) {
-		goto fail;
+	uio_uinitv(iov, iovcnt, &useruio, 0, rw);
+	result = sys_readwrite(fd, &useruio, false, retval);
+
+ out:
+	if (iov != smalliov) {
+		kfree(iov);
 	}
+	return result;
+}
 
-	if (locked) {
-		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
-		lock_release(file->of_offsetlock);
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, retval);
+}
+
+/*
+ * sendfile() - copy up to COUNT bytes from INFD to OUTFD without
+ * bringing them out to userspace. If OFFPTR isn't NULL, INFD is read
+ * at the offset found there, which is updated; otherwise at INFD's
+ * seek position. Returns the number of bytes copied.
+ */
+int
+sys_sendfile(int outfd, int infd, userptr_t offptr, size_t count,
+	     int *retval)
+{
+	struct filetable *ft;
+	struct openfile *out, *in;
+	off_t pos;
+	size_t done;
+	int result;
+
+	ft = curproc->p_filetable;
+
+	/* the result has to fit in the (signed) return value */
+	if (count > (size_t)-1 / 2) {
+		return EINVAL;
 	}
 
-	filetable_put(curproc->p_filetable, fd, file);
+	if (offptr != NULL) {
+		result = copyin(offptr, &pos, sizeof(pos));
+		if (result) {
+			return result;
+		}
+	}
 
-	/*
-	 * The amount read (or written) is the original buffer size,
-	 * minus how much is left in it.
-	 */
-	*retval = size - useruio.uio_resid;
+	result = filetable_get(ft, infd, &in);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(ft, outfd, &out);
+	if (result) {
+		filetable_put(ft, infd, in);
+		return result;
+	}
 
-	return 0;
+	result = openfile_sendfile(out, in, offptr != NULL ? &pos : NULL,
+				   count, &done);
 
-fail:
-	if (locked) {
-		lock_release(file->of_offsetlock);
+	filetable_put(ft, outfd, out);
+	filetable_put(ft, infd, in);
+	if (result) {
+		return result;
 	}
-	filetable_put(curproc->p_filetable, fd, file);
-	return result;
+
+	if (offptr != NULL) {
+		result = copyout(&pos, offptr, sizeof(pos));
+		if (result) {
+			return result;
+		}
+	}
+	*retval = done;
+	return 0;
 }
 
 /*
- * read() - use sys_readwrite
+ * pipe() - make a pipe and put its read and write ends in the file
+ * table, returning the two fds in FDS.
  */
 int
-sys_read(int fd, userptr_t buf, size_t size, int *retval)
+sys_pipe(userptr_t fds)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile, *junk;
+	int kfds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return result;
+	}
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &kfds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &kfds[1]);
+	if (result) {
+		openfile_decref(writefile);
+		goto fail;
+	}
+
+	result = copyout(kfds, fds, sizeof(kfds));
+	if (result) {
+		filetable_placeat(ft, NULL, kfds[1], &junk);
+		if (junk != NULL) {
+			openfile_decref(junk);
+		}
+		goto fail;
+	}
+	return 0;
+
+ fail:
+	/* another thread may have closed it already */
+	filetable_placeat(ft, NULL, kfds[0], &junk);
+	if (junk != NULL) {
+		openfile_decref(junk);
+	}
+	return result;
 }
 
 /*
- * write() - use sys_readwrite
+ * Number of pollfds poll keeps on the stack; more get kmalloc'd
+ * arrays.
+ */
+#define SMALL_NFDS	8
+
+/*
+ * poll() - copy in the pollfds, look up each fd, and let vfs_poll
+ * wait. Negative fds are skipped; fds that aren't open get POLLNVAL.
+ * We hold a reference to each file until we're done, so closing one
+ * underneath us doesn't pull its vnode away.
  */
 int
-sys_write(int fd, userptr_t buf, size_t size, int *retval)
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct pollfd smallfds[SMALL_NFDS], *fds;
+	struct openfile *smallfiles[SMALL_NFDS], **files;
+	struct vnode *smallvns[SMALL_NFDS], **vns;
+	struct filetable *ft;
+	unsigned i, nready;
+	int result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	if (nfds <= SMALL_NFDS) {
+		fds = smallfds;
+		files = smallfiles;
+		vns = smallvns;
+	}
+	else {
+		fds = kmalloc(nfds * sizeof(*fds));
+		files = kmalloc(nfds * sizeof(*files));
+		vns = kmalloc(nfds * sizeof(*vns));
+		if (fds == NULL || files == NULL || vns == NULL) {
+			result = ENOMEM;
+			goto out;
+		}
+	}
+
+	result = copyin(ufds, fds, nfds * sizeof(*fds));
+	if (result) {
+		goto out;
+	}
+
+	ft = curproc->p_filetable;
+	for (i=0; i<nfds; i++) {
+		files[i] = NULL;
+		vns[i] = NULL;
+		fds[i].revents = 0;
+		if (fds[i].fd < 0) {
+			continue;
+		}
+		if (filetable_get(ft, fds[i].fd, &files[i])) {
+			files[i] = NULL;
+			fds[i].revents = POLLNVAL;
+			continue;
+		}
+		vns[i] = files[i]->of_vnode;
+	}
+
+	result = vfs_poll(vns, fds, nfds, timeout, &nready);
+
+	for (i=0; i<nfds; i++) {
+		if (files[i] != NULL) {
+			filetable_put(ft, fds[i].fd, files[i]);
+		}
+	}
+
+	if (result == 0) {
+		result = copyout(fds, ufds, nfds * sizeof(*fds));
+	}
+	if (result == 0) {
+		*retval = nready;
+	}
+
+ out:
+	if (fds != smallfds) {
+		kfree(fds);
+		kfree(files);
+		kfree(vns);
+	}
+	return result;
 }
 
 /*
@@ -310,6 +600,12 @@ sys_dup2(int oldfd, int newfd, int *retval)
 		return 0;
 	}
 
+	/* make room for newfd */
+	result = filetable_reserve(ft, newfd);
+	if (result) {
+		return result;
+	}
+
 	/* get the file */
 	result = filetable_get(ft, oldfd, &oldfdfile);
 	if (result) {
@@ -333,6 +629,38 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	return 0;
 }
 
+/*
+ * fcntl() - only F_GETFL and F_SETFL, and the only flag that can be
+ * changed is O_NONBLOCK.
+ */
+int
+sys_fcntl(int fd, int cmd, int arg, int *retval)
+{
+	struct openfile *file;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &file);
+	if (result) {
+		return result;
+	}
+
+	switch (cmd) {
+	    case F_GETFL:
+		*retval = file->of_accmode | file->of_flags;
+		break;
+	    case F_SETFL:
+		file->of_flags = arg & O_NONBLOCK;
+		*retval = 0;
+		break;
+	    default:
+		result = EINVAL;
+		break;
+	}
+
+	filetable_put(curproc->p_filetable, fd, file);
+	return result;
+}
+
 /*
  * chdir() - change directory. Send the path off to the vfs layer.
  */
@@ -38,6 +38,143 @@
 #include <filetable.h>
 
 
+/* Number of bitmap words for SIZE slots. */
+#define FT_WORDS(size)	((size) / 32)
+
+/*
+ * Check, set, or clear the in-use bit for slot FD.
+ */
+static
+bool
+filetable_isused(struct filetable *ft, unsigned fd)
+{
+	return (ft->ft_used[fd / 32] & ((uint32_t)1 << (fd % 32))) != 0;
+}
+
+static
+void
+filetable_setused(struct filetable *ft, unsigned fd, bool used)
+{
+	if (used) {
+		ft->ft_used[fd / 32] |= (uint32_t)1 << (fd % 32);
+	}
+	else {
+		ft->ft_used[fd / 32] &= ~((uint32_t)1 << (fd % 32));
+	}
+}
+
+/*
+ * Allocate the slot array and (cleared) bitmap for a table of SIZE
+ * slots. The slots themselves aren't initialized.
+ */
+static
+int
+filetable_alloc(unsigned size, struct openfile ***files_ret,
+		uint32_t **used_ret)
+{
+	struct openfile **files;
+	uint32_t *used;
+
+	KASSERT(size % 32 == 0);
+
+	files = kmalloc(size * sizeof(*files));
+	used = kmalloc(FT_WORDS(size) * sizeof(*used));
+	if (files == NULL || used == NULL) {
+		kfree(files);
+		kfree(used);
+		return ENOMEM;
+	}
+	bzero(used, FT_WORDS(size) * sizeof(*used));
+
+	*files_ret = files;
+	*used_ret = used;
+	return 0;
+}
+
+/*
+ * Grow a filetable to at least MINSIZE slots, doubling. We can't
+ * allocate while holding ft_lock, so this allocates the bigger arrays
+ * with the lock dropped and then checks nobody else grew the table in
+ * the meantime.
+ */
+static
+int
+filetable_grow(struct filetable *ft, unsigned minsize)
+{
+	struct openfile **files, **oldfiles;
+	uint32_t *used, *oldused;
+	unsigned size;
+	int result;
+
+	KASSERT(minsize <= OPEN_MAX);
+
+	spinlock_acquire(&ft->ft_lock);
+	while (ft->ft_size < minsize) {
+		size = ft->ft_size;
+		while (size < minsize) {
+			size *= 2;
+		}
+		if (size > OPEN_MAX) {
+			size = OPEN_MAX;
+		}
+		spinlock_release(&ft->ft_lock);
+
+		result = filetable_alloc(size, &files, &used);
+		if (result) {
+			return result;
+		}
+
+		spinlock_acquire(&ft->ft_lock);
+		if (ft->ft_size >= size) {
+			/* someone else grew it */
+			spinlock_release(&ft->ft_lock);
+			kfree(files);
+			kfree(used);
+			spinlock_acquire(&ft->ft_lock);
+			continue;
+		}
+		memcpy(files, ft->ft_openfiles,
+		       ft->ft_size * sizeof(*files));
+		memcpy(used, ft->ft_used, FT_WORDS(ft->ft_size) * sizeof(*used));
+		oldfiles = ft->ft_openfiles;
+		oldused = ft->ft_used;
+		ft->ft_openfiles = files;
+		ft->ft_used = used;
+		ft->ft_size = size;
+		spinlock_release(&ft->ft_lock);
+
+		kfree(oldfiles);
+		kfree(oldused);
+		spinlock_acquire(&ft->ft_lock);
+	}
+	spinlock_release(&ft->ft_lock);
+	return 0;
+}
+
+/*
+ * Find the lowest free slot, or return -1 if the table is full.
+ * Caller holds ft_lock.
+ */
+static
+int
+filetable_lowestfree(struct filetable *ft)
+{
+	unsigned w, bit;
+	uint32_t bits;
+
+	for (w = 0; w < FT_WORDS(ft->ft_size); w++) {
+		bits = ft->ft_used[w];
+		if (bits == 0xffffffff) {
+			continue;
+		}
+		for (bit = 0; (bits & ((uint32_t)1 << bit)) != 0; bit++) {
+			/* nothing */
+		}
+		return w * 32 + bit;
+	}
+	return -1;
+}
+
 /*
  * Construct a filetable.
  */
@@ -45,7 +182,6 @@ struct filetable *
 filetable_create(void)
 {
 	struct filetable *ft;
-	int fd;
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
@@ -53,10 +189,13 @@ filetable_create(void)
 	}
 
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
+	if (filetable_alloc(FT_MINSIZE, &ft->ft_openfiles, &ft->ft_used)) {
+		kfree(ft);
+		return NULL;
 	}
+	ft->ft_size = FT_MINSIZE;
 
+	spinlock_init(&ft->ft_lock);
 	return ft;
 }
 
@@ -66,17 +205,25 @@ filetable_create(void)
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
+	unsigned w, bit;
 
 	KASSERT(ft != NULL);
 
 	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] != NULL) {
-			openfile_decref(ft->ft_openfiles[fd]);
-			ft->ft_openfiles[fd] = NULL;
+	for (w = 0; w < FT_WORDS(ft->ft_size); w++) {
+		if (ft->ft_used[w] == 0) {
+			continue;
+		}
+		for (bit = 0; bit < 32; bit++) {
+			if (ft->ft_used[w] & ((uint32_t)1 << bit)) {
+				openfile_decref(ft->ft_openfiles[w*32 + bit]);
+			}
 		}
+		ft->ft_used[w] = 0;
 	}
+	kfree(ft->ft_openfiles);
+	kfree(ft->ft_used);
+	spinlock_cleanup(&ft->ft_lock);
 	kfree(ft);
 }
 
@@ -94,13 +241,16 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * The copy is the same size as the original. Only the open slots are
+ * visited.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
 	struct openfile *file;
-	int fd;
+	unsigned size, w, bit;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,31 +258,60 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	dest = kmalloc(sizeof(struct filetable));
 	if (dest == NULL) {
 		return ENOMEM;
 	}
 
+	/* size it to match; if another thread grows src meanwhile, redo */
+	spinlock_acquire(&src->ft_lock);
+	while (1) {
+		size = src->ft_size;
+		spinlock_release(&src->ft_lock);
+		if (filetable_alloc(size, &dest->ft_openfiles,
+				    &dest->ft_used)) {
+			kfree(dest);
+			return ENOMEM;
+		}
+		spinlock_acquire(&src->ft_lock);
+		if (src->ft_size == size) {
+			break;
+		}
+		spinlock_release(&src->ft_lock);
+		kfree(dest->ft_openfiles);
+		kfree(dest->ft_used);
+		spinlock_acquire(&src->ft_lock);
+	}
+	dest->ft_size = size;
+
 	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		file = src->ft_openfiles[fd];
-		if (file != NULL) {
-			openfile_incref(file);
+	for (w = 0; w < FT_WORDS(size); w++) {
+		dest->ft_used[w] = src->ft_used[w];
+		if (src->ft_used[w] == 0) {
+			continue;
+		}
+		for (bit = 0; bit < 32; bit++) {
+			if (src->ft_used[w] & ((uint32_t)1 << bit)) {
+				file = src->ft_openfiles[w*32 + bit];
+				openfile_incref(file);
+				dest->ft_openfiles[w*32 + bit] = file;
+			}
 		}
-		dest->ft_openfiles[fd] = file;
 	}
+	spinlock_release(&src->ft_lock);
 
+	spinlock_init(&dest->ft_lock);
 	*dest_ret = dest;
 	return 0;
 }
 
 /*
- * Check if a file handle is in range.
+ * Check if a file handle is in range. The table grows on demand, so
+ * this only checks against the limit.
  */
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
 	(void)ft;
 
 	return (fd >= 0 && fd < OPEN_MAX);
@@ -144,7 +323,9 @@ filetable_okfd(struct filetable *ft, int fd)
  *
  * This checks that the file handle is in range and fails rather than
  * returning a null openfile; it only yields files that are actually
- * open.
+ * open. The caller gets its own reference to the file, so another
+ * thread closing the handle meanwhile doesn't pull it out from under
+ * it.
  */
 int
 filetable_get(struct filetable *ft, int fd, struct openfile **ret)
@@ -155,36 +336,36 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 		return EBADF;
 	}
 
-	file = ft->ft_openfiles[fd];
-	if (file == NULL) {
+	spinlock_acquire(&ft->ft_lock);
+	if ((unsigned)fd >= ft->ft_size || !filetable_isused(ft, fd)) {
+		spinlock_release(&ft->ft_lock);
 		return EBADF;
 	}
+	file = ft->ft_openfiles[fd];
+	openfile_incref(file);
+	spinlock_release(&ft->ft_lock);
 
 	*ret = file;
 	return 0;
 }
 
 /*
- * Put a file handle back when done with it. This does not actually do
- * anything (other than crosscheck) but it's always good practice to
- * build things so when you take them out you put them back again
- * rather than dropping them on the floor. Then if you need to do
- * something at cleanup time you can put it in this function instead
- * of having to hunt for all the places to insert the new logic.
- *
- * (For example, if you have multithreaded processes you will need to
- * insert additional lock and/or refcount manipulations here and in
- * filetable_get.)
+ * Put a file handle back when done with it. This drops the reference
+ * filetable_get took, which closes the file if some other thread has
+ * closed the handle in the meantime.
  *
  * The openfile should be the one returned from filetable_get. If you
- * want to manipulate the table so the assertion's no longer true, get
+ * want to keep using it or put it somewhere else in the table, get
  * your own reference to the openfile (with openfile_incref) and call
  * filetable_put before mucking about.
  */
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
-	KASSERT(ft->ft_openfiles[fd] == file);
+	(void)ft;
+	(void)fd;
+
+	openfile_decref(file);
 }
 
 /*
@@ -192,7 +373,7 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
  * use the smallest available descriptor, because Unix works that way.
  * (Unix works that way because in the days before dup2 was invented,
  * the behavior had to be defined explicitly in order to allow
- * manipulating stdin/stdout/stderr.)
+ * manipulating stdin/stdout/stderr.) If the table is full, it grows.
  *
  * Consumes a reference to the openfile object. (That reference is
  * placed in the table.)
@@ -200,22 +381,51 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	unsigned size;
+	int fd, result;
+
+	KASSERT(file != NULL);
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
+	spinlock_acquire(&ft->ft_lock);
+	while (1) {
+		fd = filetable_lowestfree(ft);
+		if (fd >= 0) {
 			ft->ft_openfiles[fd] = file;
+			filetable_setused(ft, fd, true);
+			spinlock_release(&ft->ft_lock);
 			*fd_ret = fd;
 			return 0;
 		}
+		size = ft->ft_size;
+		spinlock_release(&ft->ft_lock);
+
+		if (size >= OPEN_MAX) {
+			return EMFILE;
+		}
+		result = filetable_grow(ft, size + 1);
+		if (result) {
+			return result;
+		}
+		spinlock_acquire(&ft->ft_lock);
 	}
+}
 
-	return EMFILE;
+/*
+ * Make sure the table has a slot FD, which must be in range. The
+ * table never shrinks, so the slot is still there afterwards.
+ */
+int
+filetable_reserve(struct filetable *ft, int fd)
+{
+	KASSERT(filetable_okfd(ft, fd));
+
+	return filetable_grow(ft, fd + 1);
 }
 
 /*
  * Place a file in a file table at a specific location and return the
- * file previously at that location. The location must be in range.
+ * file previously at that location. The location must be in range,
+ * and if NEWFILE isn't NULL, must have been reserved.
  *
  * Consumes a reference to the passed-in openfile object; returns a
  * reference to the old openfile object (if not NULL); this should
@@ -232,6 +442,16 @@ filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 {
 	KASSERT(filetable_okfd(ft, fd));
 
-	*oldfile_ret = ft->ft_openfiles[fd];
+	spinlock_acquire(&ft->ft_lock);
+	if ((unsigned)fd >= ft->ft_size) {
+		/* past the end, so nothing was there */
+		KASSERT(newfile == NULL);
+		spinlock_release(&ft->ft_lock);
+		*oldfile_ret = NULL;
+		return;
+	}
+	*oldfile_ret = filetable_isused(ft, fd) ? ft->ft_openfiles[fd] : NULL;
 	ft->ft_openfiles[fd] = newfile;
+	filetable_setused(ft, fd, newfile != NULL);
+	spinlock_release(&ft->ft_lock);
 }
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes: sleeping and waking keyed by a user address.
+ *
+ * A user-level lock only needs the kernel when there's contention:
+ * the uncontended path is an atomic operation on an int in user
+ * memory, and a thread that loses the race calls FUTEX_WAIT on that
+ * int instead of spinning or going through a semfs file.
+ *
+ * Waiters are identified by (address space, user address) and hashed
+ * into a fixed set of buckets. Each bucket has a sleep lock, which is
+ * held across reading the user word so that the check in FUTEX_WAIT
+ * and the enqueue are atomic with respect to FUTEX_WAKE, and a CV the
+ * waiters sleep on. The wait records live on the waiters' own stacks.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/futex.h>
+#include <lib.h>
+#include <synch.h>
+#include <current.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* Number of wait buckets; a power of 2. */
+#define FUTEX_NBUCKETS 64
+
+struct futex_waiter {
+	struct futex_waiter *fw_next;
+	struct addrspace *fw_as;	/* key: address space ... */
+	vaddr_t fw_addr;		/* ... and user address */
+	struct proc *fw_proc;		/* for futex_exiting */
+	bool fw_woken;
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;
+	struct cv *fb_cv;
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_buckets[FUTEX_NBUCKETS];
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		futex_buckets[i].fb_lock = lock_create("futex");
+		futex_buckets[i].fb_cv = cv_create("futex");
+		if (futex_buckets[i].fb_lock == NULL ||
+		    futex_buckets[i].fb_cv == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_buckets[i].fb_waiters = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t addr)
+{
+	uintptr_t h;
+
+	h = (addr >> 2) ^ ((uintptr_t)as >> 4);
+	h ^= h >> 7;
+	return &futex_buckets[h & (FUTEX_NBUCKETS - 1)];
+}
+
+/*
+ * Take FW off FB's list. Caller holds fb_lock.
+ */
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+	struct futex_waiter **fwp;
+
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+
+	for (fwp = &fb->fb_waiters; *fwp != NULL; fwp = &(*fwp)->fw_next) {
+		if (*fwp == fw) {
+			*fwp = fw->fw_next;
+			fw->fw_next = NULL;
+			return;
+		}
+	}
+	panic("futex: waiter not on its bucket\n");
+}
+
+/*
+ * FUTEX_WAIT: sleep until woken, provided *ADDR is still VAL. If the
+ * process starts exiting first, give up with EINTR.
+ */
+static
+int
+futex_wait(struct addrspace *as, userptr_t addr, int val)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter fw;
+	int cur, result;
+
+	fb = futex_hash(as, (vaddr_t)addr);
+
+	lock_acquire(fb->fb_lock);
+
+	result = copyin((const_userptr_t)addr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		/* somebody changed it already; let the caller retry */
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	fw.fw_as = as;
+	fw.fw_addr = (vaddr_t)addr;
+	fw.fw_proc = curproc;
+	fw.fw_woken = false;
+	fw.fw_next = fb->fb_waiters;
+	fb->fb_waiters = &fw;
+
+	while (!fw.fw_woken && !curproc->p_exiting) {
+		cv_wait(fb->fb_cv, fb->fb_lock);
+	}
+
+	if (!fw.fw_woken) {
+		/* the process is exiting; take ourselves off */
+		futex_unlink(fb, &fw);
+		lock_release(fb->fb_lock);
+		return EINTR;
+	}
+
+	/* futex_wake unlinked us */
+	KASSERT(fw.fw_next == NULL);
+
+	lock_release(fb->fb_lock);
+	return 0;
+}
+
+/*
+ * Wake the threads of process P waiting in futex_wait, which then
+ * leave with EINTR as P is exiting. Called by _exit.
+ */
+void
+futex_exiting(struct proc *p)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter *fw;
+	unsigned i;
+
+	KASSERT(p->p_exiting);
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		fb = &futex_buckets[i];
+		lock_acquire(fb->fb_lock);
+		for (fw = fb->fb_waiters; fw != NULL; fw = fw->fw_next) {
+			if (fw->fw_proc == p) {
+				cv_broadcast(fb->fb_cv, fb->fb_lock);
+				break;
+			}
+		}
+		lock_release(fb->fb_lock);
+	}
+}
+
+/*
+ * FUTEX_WAKE: wake up to COUNT threads waiting on ADDR, oldest first.
+ */
+static
+int
+futex_wake(struct addrspace *as, userptr_t addr, int count, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **fwp, *fw, *chosen, **chosenp;
+	int woken;
+
+	if (count <= 0) {
+		*retval = 0;
+		return 0;
+	}
+
+	fb = futex_hash(as, (vaddr_t)addr);
+
+	lock_acquire(fb->fb_lock);
+
+	/* Waiters are pushed on the front, so the oldest is last. */
+	woken = 0;
+	while (woken < count) {
+		chosen = NULL;
+		chosenp = NULL;
+		for (fwp = &fb->fb_waiters; *fwp != NULL;
+		     fwp = &(*fwp)->fw_next) {
+			fw = *fwp;
+			if (fw->fw_as == as && fw->fw_addr == (vaddr_t)addr) {
+				chosen = fw;
+				chosenp = fwp;
+			}
+		}
+		if (chosen == NULL) {
+			break;
+		}
+		*chosenp = chosen->fw_next;
+		chosen->fw_next = NULL;
+		chosen->fw_woken = true;
+		woken++;
+	}
+
+	if (woken > 0) {
+		/* other keys may share the bucket; they go back to sleep */
+		cv_broadcast(fb->fb_cv, fb->fb_lock);
+	}
+
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
+
+int
+sys_futex(userptr_t addr, int op, int val, int *retval)
+{
+	struct addrspace *as;
+
+	*retval = 0;
+
+	if (addr == NULL || ((vaddr_t)addr & (sizeof(int) - 1)) != 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	KASSERT(as != NULL);
+
+	switch (op) {
+	    case FUTEX_WAIT:
+		return futex_wait(as, addr, val);
+	    case FUTEX_WAKE:
+		return futex_wake(as, addr, val, retval);
+	}
+	return EINVAL;
+}
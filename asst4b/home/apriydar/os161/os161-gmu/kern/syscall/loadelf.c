@@ -57,9 +57,130 @@
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
+#include <spinlock.h>
 #include <vnode.h>
 #include <elf.h>
 
+/*
+ * What load_elf needs out of an executable's headers: where each
+ * loadable segment is in the file and where it goes in memory, and
+ * the entry point. A program with more segments than ELF_MAXSEGS
+ * doesn't fit; for that one ei_toomany is set, it isn't cached, and
+ * load_elf reads the program headers from the file as it goes.
+ */
+#define ELF_MAXSEGS	8
+
+struct elf_segment {
+	off_t es_offset;	/* position in the file */
+	vaddr_t es_vaddr;	/* load address */
+	size_t es_memsize;	/* size in memory */
+	size_t es_filesize;	/* size in the file */
+	uint32_t es_flags;	/* PF_R, PF_W, PF_X */
+};
+
+struct elf_image {
+	vaddr_t ei_entry;
+	off_t ei_phoff;		/* where the program headers are */
+	unsigned ei_phnum;
+	unsigned ei_phentsize;
+	bool ei_toomany;	/* ei_segs overflowed */
+	unsigned ei_nsegs;
+	struct elf_segment ei_segs[ELF_MAXSEGS];
+};
+
+/*
+ * Cache of parsed executables, so that running the same program over
+ * and over doesn't read and check its headers every time. Entries are
+ * keyed by vnode and vn_version, which changes whenever the file is
+ * written or truncated and is never reused by another vnode, so a
+ * stale entry just stops matching and ages out. Replacement is LRU.
+ */
+#define ELFCACHE_SIZE	8
+
+struct elfcache_entry {
+	struct vnode *ec_vnode;		/* NULL if unused */
+	uint32_t ec_version;		/* vn_version it was read at */
+	unsigned ec_lastuse;		/* elfcache_clock at last hit */
+	struct elf_image ec_image;
+};
+
+static struct spinlock elfcache_lock = SPINLOCK_INITIALIZER;
+static struct elfcache_entry elfcache[ELFCACHE_SIZE];
+static unsigned elfcache_clock;
+static unsigned elfcache_hits, elfcache_misses;
+
+/*
+ * Look for V at VERSION in the cache; copy the image out if found.
+ */
+static
+bool
+elfcache_lookup(struct vnode *v, uint32_t version, struct elf_image *img)
+{
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (elfcache[i].ec_vnode == v &&
+		    elfcache[i].ec_version == version) {
+			*img = elfcache[i].ec_image;
+			elfcache[i].ec_lastuse = ++elfcache_clock;
+			elfcache_hits++;
+			spinlock_release(&elfcache_lock);
+			return true;
+		}
+	}
+	elfcache_misses++;
+	spinlock_release(&elfcache_lock);
+	return false;
+}
+
+/*
+ * Remember IMG as what V looked like at VERSION, unless V has been
+ * changed since then, in which case IMG may be a mix of old and new.
+ */
+static
+void
+elfcache_insert(struct vnode *v, uint32_t version,
+		const struct elf_image *img)
+{
+	struct elfcache_entry *ec;
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	if (v->vn_version != version) {
+		spinlock_release(&elfcache_lock);
+		return;
+	}
+	ec = &elfcache[0];
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (elfcache[i].ec_vnode == v) {
+			/* an older version of the same file */
+			ec = &elfcache[i];
+			break;
+		}
+		if (elfcache[i].ec_lastuse < ec->ec_lastuse) {
+			ec = &elfcache[i];
+		}
+	}
+	ec->ec_vnode = v;
+	ec->ec_version = version;
+	ec->ec_lastuse = ++elfcache_clock;
+	ec->ec_image = *img;
+	spinlock_release(&elfcache_lock);
+}
+
+/*
+ * Report the cache's hit and miss counts, for benchmarks.
+ */
+void
+load_elf_stats(unsigned *hits, unsigned *misses)
+{
+	spinlock_acquire(&elfcache_lock);
+	*hits = elfcache_hits;
+	*misses = elfcache_misses;
+	spinlock_release(&elfcache_lock);
+}
+
 /*
  * Load a segment at virtual address VADDR. The segment in memory
  * extends from VADDR up to (but not including) VADDR+MEMSIZE. The
@@ -102,6 +223,7 @@ load_segment(struct addrspace *as, struct vnode *v,
 	u.uio_segflg = is_executable ? UIO_USERISPACE : UIO_USERSPACE;
 	u.uio_rw = UIO_READ;
 	u.uio_space = as;
+	u.uio_nonblock = false;
 
 	result = VOP_READ(v, &u);
 	if (result) {
@@ -146,21 +268,78 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
- *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Read program header I of the executable IMG describes into ES.
+ * *LOADABLE is set to false for the kinds of segment we skip.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+elf_readphdr(struct vnode *v, const struct elf_image *img, unsigned i,
+	     struct elf_segment *es, bool *loadable)
 {
-	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
-	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
+	off_t offset;
+	int result;
 
-	as = proc_getas();
+	/*
+	 * Note that the expression e_phoff + i*e_phentsize is
+	 * mandated by the ELF standard - we use sizeof(ph) to load,
+	 * because that's the structure we know, but the file on disk
+	 * might have a larger structure, so we must use e_phentsize
+	 * to find where the phdr starts.
+	 */
+	offset = img->ei_phoff + i*img->ei_phentsize;
+	uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
+
+	result = VOP_READ(v, &ku);
+	if (result) {
+		return result;
+	}
+
+	if (ku.uio_resid != 0) {
+		/* short read; problem with executable? */
+		kprintf("ELF: short read on phdr - file truncated?\n");
+		return ENOEXEC;
+	}
+
+	switch (ph.p_type) {
+	    case PT_NULL: /* skip */
+	    case PT_PHDR: /* skip */
+	    case PT_MIPS_REGINFO: /* skip */
+		*loadable = false;
+		return 0;
+	    case PT_LOAD: break;
+	    default:
+		kprintf("loadelf: unknown segment type %d\n",
+			ph.p_type);
+		return ENOEXEC;
+	}
+
+	es->es_offset = ph.p_offset;
+	es->es_vaddr = ph.p_vaddr;
+	es->es_memsize = ph.p_memsz;
+	es->es_filesize = ph.p_filesz;
+	es->es_flags = ph.p_flags;
+	*loadable = true;
+	return 0;
+}
+
+/*
+ * Read and check the executable header and the program headers of V,
+ * and collect the loadable segments into IMG.
+ */
+static
+int
+elf_readimage(struct vnode *v, struct elf_image *img)
+{
+	Elf_Ehdr eh;   /* Executable header */
+	int result;
+	unsigned i;
+	struct iovec iov;
+	struct uio ku;
+	struct elf_segment es;
+	bool loadable;
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -202,52 +381,108 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return ENOEXEC;
 	}
 
+	img->ei_entry = eh.e_entry;
+	img->ei_phoff = eh.e_phoff;
+	img->ei_phnum = eh.e_phnum;
+	img->ei_phentsize = eh.e_phentsize;
+
 	/*
-	 * Go through the list of segments and set up the address space.
+	 * Go through the list of segments and collect the loadable ones.
 	 *
 	 * Ordinarily there will be one code segment, one read-only
 	 * data segment, and one data/bss segment, but there might
-	 * conceivably be more. You don't need to support such files
-	 * if it's unduly awkward to do so.
-	 *
-	 * Note that the expression eh.e_phoff + i*eh.e_phentsize is
-	 * mandated by the ELF standard - we use sizeof(ph) to load,
-	 * because that's the structure we know, but the file on disk
-	 * might have a larger structure, so we must use e_phentsize
-	 * to find where the phdr starts.
+	 * conceivably be more. If there are more than fit, stop;
+	 * load_elf then goes through the program headers itself.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
+	img->ei_toomany = false;
+	img->ei_nsegs = 0;
+	for (i=0; i<img->ei_phnum; i++) {
+		result = elf_readphdr(v, img, i, &es, &loadable);
 		if (result) {
 			return result;
 		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
+		if (!loadable) {
+			continue;
 		}
+		if (img->ei_nsegs == ELF_MAXSEGS) {
+			img->ei_toomany = true;
+			break;
+		}
+		img->ei_segs[img->ei_nsegs++] = es;
+	}
+
+	return 0;
+}
+
+/*
+ * Get segment I of IMG: from the image if it all fit, and otherwise
+ * by reading program header I again.
+ */
+static
+int
+elf_getsegment(struct vnode *v, const struct elf_image *img, unsigned i,
+	       struct elf_segment *es, bool *loadable)
+{
+	if (img->ei_toomany) {
+		return elf_readphdr(v, img, i, es, loadable);
+	}
+	*es = img->ei_segs[i];
+	*loadable = true;
+	return 0;
+}
 
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n",
-				ph.p_type);
-			return ENOEXEC;
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct elf_image img;
+	struct elf_segment es;
+	struct addrspace *as;
+	uint32_t version;
+	unsigned i, nsegs;
+	bool loadable;
+	int result;
+
+	as = proc_getas();
+
+	/*
+	 * Get the segment list, from the cache if this version of the
+	 * file has been run before.
+	 */
+	version = v->vn_version;
+	if (!elfcache_lookup(v, version, &img)) {
+		result = elf_readimage(v, &img);
+		if (result) {
+			return result;
+		}
+		if (!img.ei_toomany) {
+			elfcache_insert(v, version, &img);
 		}
+	}
+	nsegs = img.ei_toomany ? img.ei_phnum : img.ei_nsegs;
+
+	/*
+	 * Set up the address space.
+	 */
 
+	for (i=0; i<nsegs; i++) {
+		result = elf_getsegment(v, &img, i, &es, &loadable);
+		if (result) {
+			return result;
+		}
+		if (!loadable) {
+			continue;
+		}
 		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
+					  es.es_vaddr, es.es_memsize,
+					  es.es_flags & PF_R,
+					  es.es_flags & PF_W,
+					  es.es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -262,35 +497,17 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * Now actually load each segment.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
+	for (i=0; i<nsegs; i++) {
+		result = elf_getsegment(v, &img, i, &es, &loadable);
 		if (result) {
 			return result;
 		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
+		if (!loadable) {
+			continue;
 		}
-
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n",
-				ph.p_type);
-			return ENOEXEC;
-		}
-
-		result = load_segment(as, v, ph.p_offset, ph.p_vaddr,
-				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
+		result = load_segment(as, v, es.es_offset, es.es_vaddr,
+				      es.es_memsize, es.es_filesize,
+				      es.es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -301,7 +518,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
-	*entrypoint = eh.e_entry;
+	*entrypoint = img.ei_entry;
 
 	return 0;
 }
@@ -35,8 +35,10 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <lib.h>
+#include <uio.h>
 #include <synch.h>
 #include <vfs.h>
+#include <vnode.h>
 #include <openfile.h>
 
 /*
@@ -68,6 +70,7 @@ openfile_create(struct vnode *vn, int accmode)
 
 	file->of_vnode = vn;
 	file->of_accmode = accmode;
+	file->of_flags = 0;
 	file->of_offset = 0;
 	file->of_refcount = 1;
 
@@ -111,6 +114,26 @@ openfile_open(char *filename, int openflags, mode_t mode,
 		vfs_close(vn);
 		return ENOMEM;
 	}
+	file->of_flags = openflags & O_NONBLOCK;
+
+	*ret = file;
+	return 0;
+}
+
+/*
+ * Wrap a vnode that didn't come from vfs_open (such as a pipe end) in
+ * an openfile object. Consumes the caller's reference to the vnode if
+ * it succeeds.
+ */
+int
+openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret)
+{
+	struct openfile *file;
+
+	file = openfile_create(vn, accmode);
+	if (file == NULL) {
+		return ENOMEM;
+	}
 
 	*ret = file;
 	return 0;
@@ -147,3 +170,154 @@ openfile_decref(struct openfile *file)
 		spinlock_release(&file->of_reflock);
 	}
 }
+
+/*
+ * Check if FILE was opened for reading or writing, as RW asks.
+ */
+static
+bool
+openfile_canaccess(struct openfile *file, enum uio_rw rw)
+{
+	return file->of_accmode != (rw == UIO_READ ? O_WRONLY : O_RDONLY);
+}
+
+/*
+ * Read or write an open file at its seek position, which is advanced
+ * by however much was transferred. The uio's own offset is ignored.
+ * Returns EBADF if the file wasn't opened for this direction. If the
+ * file is O_NONBLOCK, objects that would wait return EAGAIN instead.
+ *
+ * The whole uio goes through a single VOP_READ or VOP_WRITE, holding
+ * the offset lock once, however many iovecs it has; that's the point
+ * of readv and writev.
+ */
+int
+openfile_readwrite(struct openfile *file, struct uio *uio)
+{
+	bool locked;
+	int result;
+
+	if (!openfile_canaccess(file, uio->uio_rw)) {
+		return EBADF;
+	}
+	uio->uio_nonblock = (file->of_flags & O_NONBLOCK) != 0;
+
+	/* Only lock the seek position if we're really using it. */
+	locked = VOP_ISSEEKABLE(file->of_vnode);
+	if (locked) {
+		lock_acquire(file->of_offsetlock);
+		uio->uio_offset = file->of_offset;
+	}
+	else {
+		uio->uio_offset = 0;
+	}
+
+	result = (uio->uio_rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, uio) :
+		VOP_WRITE(file->of_vnode, uio);
+
+	if (locked) {
+		if (result == 0) {
+			/* set the offset to the updated offset in the uio */
+			file->of_offset = uio->uio_offset;
+		}
+		lock_release(file->of_offsetlock);
+	}
+	return result;
+}
+
+/*
+ * Read or write an open file at the offset given in the uio, for
+ * pread and pwrite. The seek position isn't used or changed, so this
+ * doesn't take the offset lock and any number of threads can be in
+ * here on the same file at once. Files that can't seek fail with
+ * ESPIPE.
+ */
+int
+openfile_preadwrite(struct openfile *file, struct uio *uio)
+{
+	if (!openfile_canaccess(file, uio->uio_rw)) {
+		return EBADF;
+	}
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		return ESPIPE;
+	}
+	if (uio->uio_offset < 0) {
+		return EINVAL;
+	}
+	uio->uio_nonblock = (file->of_flags & O_NONBLOCK) != 0;
+
+	return (uio->uio_rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, uio) :
+		VOP_WRITE(file->of_vnode, uio);
+}
+
+/*
+ * Copy up to COUNT bytes from IN to OUT through a kernel buffer,
+ * the work of sendfile. If POS is not NULL, IN is read from *POS,
+ * which is advanced, and its seek position is left alone; otherwise
+ * it's read at its seek position. OUT is always written at its seek
+ * position. Stops early at end of file on IN or on a short write to
+ * OUT. The amount copied is returned in *DONE; if that's nonzero,
+ * an error partway is not reported.
+ *
+ * After a short write, IN's seek position is moved back over what
+ * was read but not written, so it gets sent next time. (If IN can't
+ * seek, as with a pipe, that data is gone.)
+ */
+int
+openfile_sendfile(struct openfile *out, struct openfile *in, off_t *pos,
+		  size_t count, size_t *done)
+{
+	struct iovec iov;
+	struct uio ku;
+	char *buf;
+	size_t len, got, put;
+	int result;
+
+	buf = kbuf_alloc(SENDFILE_BUFSIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+
+	result = 0;
+	*done = 0;
+	while (*done < count) {
+		len = count - *done;
+		if (len > SENDFILE_BUFSIZE) {
+			len = SENDFILE_BUFSIZE;
+		}
+
+		if (pos != NULL) {
+			uio_kinit(&iov, &ku, buf, len, *pos, UIO_READ);
+			result = openfile_preadwrite(in, &ku);
+		}
+		else {
+			uio_kinit(&iov, &ku, buf, len, 0, UIO_READ);
+			result = openfile_readwrite(in, &ku);
+		}
+		got = len - ku.uio_resid;
+		if (result || got == 0) {
+			break;
+		}
+
+		uio_kinit(&iov, &ku, buf, got, 0, UIO_WRITE);
+		result = openfile_readwrite(out, &ku);
+		put = got - ku.uio_resid;
+		*done += put;
+		if (pos != NULL) {
+			*pos += put;
+		}
+		else if (put < got && VOP_ISSEEKABLE(in->of_vnode)) {
+			lock_acquire(in->of_offsetlock);
+			in->of_offset -= got - put;
+			lock_release(in->of_offsetlock);
+		}
+		if (result || put < got) {
+			break;
+		}
+	}
+
+	kbuf_free(buf, SENDFILE_BUFSIZE);
+	return *done > 0 ? 0 : result;
+}
@@ -6,6 +6,10 @@
 #include <kern/seek.h>
 #include <kern/stat.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <kern/spawn.h>
+#include <kern/vmstat.h>
 #include <lib.h>
 #include <uio.h>
 #include <proc.h>
@@ -13,6 +17,7 @@
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <aio.h>
 #include <current.h>
 #include <synch.h>
 #include <copyinout.h>
@@ -20,6 +25,7 @@
 #include <addrspace.h>
 #include <thread.h>
 #include <syscall.h>
+#include <clock.h>
 
 
 int sys_getpid(int *retval)
@@ -32,33 +38,34 @@ int sys_getpid(int *retval)
 
 void sys__exit(int exitcode)
 {
-    	struct addrspace* as;
 	struct proc* p = curproc;
 
     	//DEBUG(DB_EXEC, "_exit(): process %u\n",p->p_pid);
     
 	KASSERT(p->p_addrspace != NULL);
 
-    
-    	as_deactivate();
-    	as = proc_setas(NULL);
-    	as_destroy(as);
-
-    	proc_remthread(curthread);
-
-    	spinlock_acquire(&p->p_lock);
-
-    	p->p_exitval = _MKWAIT_EXIT(exitcode);
-    	p->p_finished = true;
-    	spinlock_release(&p->p_lock);
-
-    	V( p->p_sem );
-	//DEBUG(DB_EXEC, "_exit(): V p_sem %u\n",p->p_sem->sem_count);
+	/*
+	 * Take the whole process down: the other threads leave as soon
+	 * as they next enter the kernel, and whichever is last out
+	 * makes the process a zombie with this status. Threads asleep
+	 * in the kernel waiting for something that may never happen
+	 * (futex_wait, or anything using proc_sleep) get woken to
+	 * notice; uthread_leave wakes any in thread_join.
+	 */
+	spinlock_acquire(&p->p_lock);
+	if (!p->p_exiting) {
+		p->p_exitstatus = _MKWAIT_EXIT(exitcode);
+		p->p_exiting = true;
+	}
+	spinlock_release(&p->p_lock);
 
+	if (p->p_thrlock != NULL) {
+		/* there may be other threads */
+		proc_wakesleepers(p);
+		futex_exiting(p);
+	}
 
-    	proc_destroy(p);
-    	thread_exit();
-    	panic("_exit: thread could not exit()\n");
+	uthread_leave(0);
 }
 
 
@@ -68,38 +75,23 @@ int sys_waitpid(pid_t pid,
 	    int* retval
             )
 {
-   
-    int result;
+	int exitval, result;
 
-    struct proc* wp = curproc; // waiting  process
-    struct proc* child = proc_get_process(pid);
-
-	if(pid < 1)
-		return ECHILD;
 	if (options != 0)
         	return EINVAL;
-	if(child == NULL) 
-        {
-            DEBUG(DB_EXEC,"waitpid: invalid child pid\n");
-            return ECHILD;
-        }
-	if (wp != kproc && child->p_parent != wp)
-    	{
-        	//given pid is not of this process's child and current waiting process is not kernel process
-        	DEBUG(DB_EXEC,"waitpid: ECHILD\n");
-        	return ECHILD;
-    	}
+	if(pid < 1)
+		return ECHILD;
+
+	/* sleeps until the child exits */
+	result = proc_wait(pid, &exitval);
+	if (result) {
+		DEBUG(DB_EXEC,"waitpid: ECHILD\n");
+		return result;
+	}
+
         if(status != NULL)
 	{
-		//waiting on child:
-        	while(!child->p_finished);
-		P(child->p_sem); //for wait-exit logic
-   		//DEBUG(DB_EXEC, "P sem %u\n",child->p_sem->sem_count); 
-		//if(status != NULL){
-    		spinlock_acquire(&child->p_lock);
-		result = copyout(&child->p_exitval,status,sizeof(int));
-	        spinlock_release(&child->p_lock);
-
+		result = copyout(&exitval,status,sizeof(int));
     		if(result)
     		{
         		return EFAULT;
@@ -109,6 +101,82 @@ int sys_waitpid(pid_t pid,
     	return 0;
 }
 
+/*
+ * Convert a count of hardclock ticks to a timeval.
+ */
+static
+void
+ticks_to_timeval(unsigned ticks, struct timeval *tv)
+{
+	tv->tv_sec = ticks / HZ;
+	tv->tv_usec = (ticks % HZ) * (1000000 / HZ);
+}
+
+/*
+ * getrusage: report the CPU usage of the current process (all its
+ * threads, live or exited) or of its reaped children. Only the
+ * fields we keep are filled in; the rest are zero. With no paging
+ * to disk every VM fault counts as minor.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+	struct cpuusage self, children, *cu;
+	struct rusage ru;
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		proc_getusage(curproc, &self, NULL);
+		cu = &self;
+		break;
+	    case RUSAGE_CHILDREN:
+		proc_getusage(curproc, NULL, &children);
+		cu = &children;
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	bzero(&ru, sizeof(ru));
+	ticks_to_timeval(cu->cu_utime, &ru.ru_utime);
+	ticks_to_timeval(cu->cu_stime, &ru.ru_stime);
+	ru.ru_minflt = cu->cu_nfaults;
+	ru.ru_nvcsw = cu->cu_nvcsw;
+	ru.ru_nivcsw = cu->cu_nivcsw;
+
+	return copyout(&ru, usage, sizeof(ru));
+}
+
+/*
+ * vmstat: copy out the fault counts for up to NSTATS regions of the
+ * current process's address space, and return how many regions it
+ * has.
+ */
+int
+sys_vmstat(userptr_t stats, unsigned nstats, int *retval)
+{
+	struct vmregionstat vs[VMSTAT_MAXREGIONS];
+	struct addrspace *as;
+	unsigned n;
+	int result;
+
+	as = proc_getas();
+	if (as == NULL) {
+		return EFAULT;
+	}
+
+	n = as_getstats(as, vs, VMSTAT_MAXREGIONS);
+	if (nstats > n) {
+		nstats = n;
+	}
+	result = copyout(vs, stats, nstats * sizeof(vs[0]));
+	if (result) {
+		return result;
+	}
+	*retval = n;
+	return 0;
+}
+
 
 int sys_fork(struct trapframe* p_tf, int *retval)
 {
@@ -164,15 +232,9 @@ int sys_fork(struct trapframe* p_tf, int *retval)
 	memcpy(child_tf, p_tf, sizeof(struct trapframe));
     	// DEBUG(DB_EXEC,"fork: tf copied\n");
     	filetable_copy(curproc->p_filetable,&child_proc->p_filetable);
-    	child_proc->p_parent = curproc;
 	// DEBUG(DB_EXEC,"fork: filetable copied\n");
     
-    	result = (int)array_add(curproc->p_children, (void*)child_proc->p_pid, NULL);
-    	if (result)
-    	{
-        	DEBUG(DB_EXEC,"fork: couldnt add to array\n");
-       	 	return result;
-    	}
+	proc_addchild(curproc, child_proc);
         DEBUG(DB_EXEC,"fork: p %u has child %u\n",curproc->p_pid,child_proc->p_pid);
     	result = thread_fork(child_name, child_proc, &enter_forked_process, child_tf, 1);
     
@@ -196,175 +258,592 @@ int sys_fork(struct trapframe* p_tf, int *retval)
 
 
 
+/*
+ * vfork: like fork, but the child runs in our address space instead
+ * of a copy of it, and we sleep until it's done with it, that is,
+ * until it calls execv or exits. Meanwhile the child must not return
+ * from the function that called vfork.
+ */
 int
-sys_execv(const_userptr_t path, userptr_t argv)
+sys_vfork(struct trapframe *p_tf, pid_t *retval)
 {
-	if (path == NULL)
-	{
-		return EFAULT;
+	struct proc *child;
+	struct trapframe *child_tf;
+	pid_t pid;
+	int result;
+
+	KASSERT(curproc->p_addrspace != NULL);
+
+	result = proc_fork(&child);
+	if (result) {
+		return result;
 	}
-	// memory for path
-	char* kernel_path = kmalloc(PATH_MAX);
-	DEBUG(DB_KMALLOC,"execv: pathmax, &kernel_path %d:%p\n",PATH_MAX,&kernel_path);
-	if (kernel_path == NULL)
-	{
+
+	child_tf = kmalloc(sizeof(*child_tf));
+	if (child_tf == NULL) {
+		proc_destroy(child);
 		return ENOMEM;
 	}
-	// copying user path into kernel
-	size_t arglen;
-	int result = copyinstr(path, kernel_path, PATH_MAX, &arglen);
-	if (result)
-	{
+	memcpy(child_tf, p_tf, sizeof(*child_tf));
+
+	child->p_addrspace = curproc->p_addrspace;
+	child->p_vforked = true;
+	proc_addchild(curproc, child);
+	pid = child->p_pid;
+
+	result = thread_fork(curthread->t_name, child, &enter_forked_process,
+			     child_tf, 0);
+	if (result) {
+		kfree(child_tf);
+		/* the address space is still ours */
+		child->p_addrspace = NULL;
+		proc_destroy(child);
 		return result;
 	}
-	if (strcmp(kernel_path,"") == 0)
-	{
-		return EINVAL;
+
+	proc_vforkwait(child);
+
+	*retval = pid;
+	return 0;
+}
+
+/*
+ * Exec arguments.
+ *
+ * A new program's arguments are gathered into one ARG_MAX buffer laid
+ * out exactly as they will sit at the top of its user stack: the argv
+ * array, NULL-terminated, followed by the strings. While they're in
+ * the kernel each argv slot holds its string's offset in the buffer;
+ * exec_copyoutargs turns the offsets into user addresses and sends
+ * the whole block out with a single copyout. The buffer comes from
+ * kbuf_alloc, so it isn't allocated from scratch on every exec.
+ */
+int
+execargs_init(struct execargs *ea)
+{
+	ea->ea_buf = kbuf_alloc(ARG_MAX);
+	if (ea->ea_buf == NULL) {
+		return ENOMEM;
 	}
-	
-	char** user_argv = (char**) argv; //arguments gotta be char**
-	userptr_t test;
-	if(argv != NULL)
-	{
-		result = copyin((const_userptr_t)argv,&test,sizeof(userptr_t));
-		if (result)
-		{
+	ea->ea_argc = 0;
+	ea->ea_len = 0;
+	return 0;
+}
+
+void
+execargs_cleanup(struct execargs *ea)
+{
+	KASSERT(ea->ea_buf != NULL);
+
+	kbuf_free(ea->ea_buf, ARG_MAX);
+	ea->ea_buf = NULL;
+}
+
+/*
+ * Fill EA from kernel strings, for kernel callers of spawn_program.
+ */
+int
+execargs_kernel(struct execargs *ea, int argc, char **argv)
+{
+	vaddr_t *slots = (vaddr_t *)ea->ea_buf;
+	size_t off, len;
+	int i;
+
+	off = (argc + 1) * sizeof(vaddr_t);
+	if (off > ARG_MAX) {
+		return E2BIG;
+	}
+	for (i=0; i<argc; i++) {
+		len = strlen(argv[i]) + 1;
+		if (len > ARG_MAX - off) {
+			return E2BIG;
+		}
+		memcpy(ea->ea_buf + off, argv[i], len);
+		slots[i] = off;
+		off += len;
+	}
+	slots[argc] = 0;
+
+	ea->ea_argc = argc;
+	ea->ea_len = off;
+	return 0;
+}
+
+/*
+ * Copy in the NULL-terminated user argument vector ARGV. The user
+ * pointers go straight into the argv slots, then each string is
+ * copied in after the array and its slot set to the string's offset.
+ */
+static
+int
+exec_copyinargs(struct execargs *ea, userptr_t argv)
+{
+	vaddr_t *slots = (vaddr_t *)ea->ea_buf;
+	size_t off, len;
+	int argc, i, result;
+
+	for (argc = 0; ; argc++) {
+		if ((argc + 1) * sizeof(vaddr_t) > ARG_MAX) {
+			return E2BIG;
+		}
+		result = copyin((const_userptr_t)
+				((vaddr_t)argv + argc * sizeof(vaddr_t)),
+				&slots[argc], sizeof(vaddr_t));
+		if (result) {
 			return result;
 		}
+		if (slots[argc] == 0) {
+			break;
+		}
 	}
-	int argc = 0;
-	if(user_argv == NULL)
-	{
-		return EFAULT;
+
+	off = (argc + 1) * sizeof(vaddr_t);
+	for (i=0; i<argc; i++) {
+		result = copyinstr((const_userptr_t)slots[i],
+				   ea->ea_buf + off, ARG_MAX - off, &len);
+		if (result == ENAMETOOLONG) {
+			result = E2BIG;
+		}
+		if (result) {
+			return result;
+		}
+		slots[i] = off;
+		off += len;
 	}
-	//counting args in argc
-	for (argc = 0; user_argv[argc] != NULL; argc++);
 
-	if (argc > ARG_MAX)
-	{
-		return E2BIG;
+	ea->ea_argc = argc;
+	ea->ea_len = off;
+	return 0;
+}
+
+/*
+ * Program loading, shared by execv and spawn.
+ */
+
+/*
+ * Load the program PATH into a fresh address space and switch the
+ * current process to it. The old address space (possibly NULL) is
+ * handed back for the caller to dispose of; on failure it's put back
+ * instead. Destroys PATH, like vfs_open.
+ */
+static
+int
+exec_loadprog(char *path, struct addrspace **oldas_ret,
+	      vaddr_t *entrypoint, vaddr_t *stackptr)
+{
+	struct addrspace *as, *oldas;
+	struct vnode *v;
+	int result;
+
+	result = vfs_open(path, O_RDONLY, 0, &v);
+	if (result) {
+		return result;
 	}
-	// copying argv from user to kernel space
-	int arg_size = (argc+1) * sizeof(char*);
-	char** kernel_argv = kmalloc(arg_size);
-	DEBUG(DB_KMALLOC,"execv: argsize:kernel_argv %d:%p\n",arg_size,&kernel_argv);
-	if (kernel_argv == NULL)
-	{
+
+	as = as_create();
+	if (as == NULL) {
+		vfs_close(v);
 		return ENOMEM;
 	}
-	for (int i=0; i<argc; i++)
-	{
-		kernel_argv[i] = kmalloc(PATH_MAX);
-		DEBUG(DB_KMALLOC,"execv: pathmax:kernel_argv[?]: %d:%p\n",PATH_MAX,&kernel_argv[i]);
-		result = copyinstr((const_userptr_t)user_argv[i], kernel_argv[i], PATH_MAX, &arglen);
-		if (result)
-		{
-			return result;
-		}
+
+	oldas = proc_setas(as);
+	as_activate();
+
+	result = load_elf(v, entrypoint);
+	vfs_close(v);
+	if (result == 0) {
+		result = as_define_stack(as, stackptr);
 	}
-	// NULL at the end of argv
-	kernel_argv[argc] = NULL;
-	// Open the program file
-	char* name = kstrdup(kernel_path);
-	struct vnode* v;
-	result = vfs_open(name, O_RDONLY, 0, &v);
-	kfree(name);
-	if (result)
-	{
-		return ENOMEM;
+	if (result) {
+		proc_setas(oldas);
+		as_activate();
+		as_destroy(as);
+		return result;
+	}
+
+	*oldas_ret = oldas;
+	return 0;
+}
+
+/*
+ * Copy the arguments out onto the new user stack in one go, just
+ * below STACKPTR, keeping the stack 8-byte aligned. Updates STACKPTR
+ * and returns the user address of argv. Uses up EA.
+ */
+static
+int
+exec_copyoutargs(struct execargs *ea, vaddr_t *stackptr, userptr_t *argv_ret)
+{
+	vaddr_t *slots = (vaddr_t *)ea->ea_buf;
+	vaddr_t base;
+	int i, result;
+
+	base = (*stackptr - ea->ea_len) & ~(vaddr_t)7;
+	for (i=0; i<ea->ea_argc; i++) {
+		slots[i] += base;
+	}
+
+	result = copyout(ea->ea_buf, (userptr_t)base, ea->ea_len);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = base;
+	*argv_ret = (userptr_t)base;
+	return 0;
+}
+
+int
+sys_execv(const_userptr_t path, userptr_t argv)
+{
+	struct addrspace *as, *oldas;
+	struct execargs ea;
+	char *kpath;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	int argc, result;
+
+	if (path == NULL || argv == NULL) {
+		return EFAULT;
 	}
-	// Creating new address space 
-	KASSERT(proc_getas() != NULL);
-	struct addrspace* existing_as = proc_getas();
+
+	/*
+	 * We can't pull the address space out from under other
+	 * threads, and there's no way to make them go first.
+	 */
 	spinlock_acquire(&curproc->p_lock);
-	curproc->p_addrspace = as_create();
+	result = threadarray_num(&curproc->p_threads) > 1 ? EBUSY : 0;
 	spinlock_release(&curproc->p_lock);
-	if (curproc->p_addrspace == NULL)
-	{
-		vfs_close(v);
+	if (result) {
+		return result;
+	}
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
 		return ENOMEM;
 	}
-	as_activate();
+	result = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+	if (kpath[0] == '\0') {
+		kfree(kpath);
+		return EINVAL;
+	}
 
-	// Loading program exec file by load-elf
-	vaddr_t entrypoint;
-	result = load_elf(v, &entrypoint);
-	if (result)
-	{
-		vfs_close(v);
+	result = execargs_init(&ea);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+	result = exec_copyinargs(&ea, argv);
+	if (result) {
+		execargs_cleanup(&ea);
+		kfree(kpath);
 		return result;
 	}
-	vfs_close(v);
 
-	//new user stack
-	vaddr_t stackptr;
-	result = as_define_stack(curproc->p_addrspace, &stackptr);
-	if (result)
-	{
+	result = exec_loadprog(kpath, &oldas, &entrypoint, &stackptr);
+	kfree(kpath);
+	if (result) {
+		execargs_cleanup(&ea);
 		return result;
 	}
-	// Allocate space for address pointers
-	char** addr_ptr = kmalloc((argc+1)*sizeof(char*));
-	DEBUG(DB_KMALLOC,"execv: ?:addr_ptr %d:%p\n",(argc+1)*sizeof(char*),&addr_ptr);
-	if (addr_ptr == NULL)
-	{
-		return ENOMEM;
+
+	argc = ea.ea_argc;
+	result = exec_copyoutargs(&ea, &stackptr, &uargv);
+	execargs_cleanup(&ea);
+	if (result) {
+		/* go back to the old image */
+		as = proc_setas(oldas);
+		as_activate();
+		as_destroy(as);
+		return result;
 	}
-	for (int i=argc-1; i>=0; i--) //copying args into stack in reverse
-	{
-		char* arg = kernel_argv[i];
-		int len = strlen(arg)+1;
-		int shift = 0;//len%4;
-		//if(shift ==0)	shift =4;	//4-byte aligning that did not work. 
-		stackptr-= (len+shift);
-		result = copyoutstr(arg, (userptr_t)stackptr, len, &arglen);
-		if (result)
-		{
-			return result;
+
+	/*
+	 * No going back now. Outstanding AIO belongs to the old image
+	 * (its reads are bound for user addresses that won't mean the
+	 * same thing any more), so that goes. If we were vforked the
+	 * old address space belongs to our parent; give it back
+	 * instead of destroying it.
+	 */
+	aioctx_detach();
+	if (curproc->p_vforked) {
+		proc_vforkdone(curproc);
+	}
+	else if (oldas != NULL) {
+		as_destroy(oldas);
+	}
+
+	enter_new_process(argc, uargv, NULL, stackptr, entrypoint);
+	panic("enter_new_process returned unexpectedly!!!\n");
+	return EINVAL;
+}
+
+/*
+ * spawn
+ */
+
+/* Handoff from spawn_program to the child's first thread. */
+struct spawnargs {
+	char *sa_path;
+	struct execargs *sa_args;
+	struct semaphore *sa_done;
+	int sa_result;
+};
+
+/*
+ * First thing the spawned child runs: load the program, report back
+ * to the parent, and go to user mode. If loading fails the child
+ * exits and the parent reaps it.
+ */
+static
+void
+spawn_enter(void *data1, unsigned long data2)
+{
+	struct spawnargs *sa = data1;
+	struct proc *proc = curproc;
+	struct addrspace *as;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	int argc, result;
+
+	(void)data2;
+	KASSERT(proc_getas() == NULL);
+
+	argc = sa->sa_args->ea_argc;
+	result = exec_loadprog(sa->sa_path, &as, &entrypoint, &stackptr);
+	if (result == 0) {
+		KASSERT(as == NULL);
+		result = exec_copyoutargs(sa->sa_args, &stackptr, &uargv);
+	}
+
+	/* SA is the parent's, and goes away once we signal it */
+	sa->sa_result = result;
+	V(sa->sa_done);
+
+	if (result) {
+		as = proc_setas(NULL);
+		as_deactivate();
+		if (as != NULL) {
+			as_destroy(as);
 		}
-		addr_ptr[i] = (char*)stackptr;
+		proc_remthread(curthread);
+		proc_exit(proc, _MKWAIT_EXIT(127));
+		thread_exit();
 	}
-	addr_ptr[argc] = NULL;
-	
-	for(int i = argc-1;i >=0;i--)
-	{
-		stackptr-=4;
-		copyout(&addr_ptr[i], (userptr_t)stackptr, sizeof(addr_ptr[i]));
+
+	enter_new_process(argc, uargv, NULL, stackptr, entrypoint);
+	panic("enter_new_process returned unexpectedly!!!\n");
+}
+
+/*
+ * Start the program PATH with arguments ARGS (all kernel pointers)
+ * in CHILD, a new process with no address space that's already a
+ * child of the current process. Returns once the program is loaded,
+ * or with the reason it couldn't be, in which case CHILD is gone.
+ * Destroys PATH and uses up ARGS.
+ */
+int
+spawn_program(struct proc *child, char *path, struct execargs *args)
+{
+	struct spawnargs sa;
+	int status, result;
+
+	KASSERT(child->p_parent == curproc);
+	KASSERT(child->p_addrspace == NULL);
+
+	sa.sa_path = path;
+	sa.sa_args = args;
+	sa.sa_result = 0;
+	sa.sa_done = sem_create("spawn", 0);
+	if (sa.sa_done == NULL) {
+		proc_destroy(child);
+		return ENOMEM;
 	}
 
-	int remaining_bytes = stackptr%4; //4-byte aligning
-	stackptr-=remaining_bytes;
-	bzero((void*)stackptr, remaining_bytes);
-	int offset = (argc+1)*sizeof(char*);
-	stackptr-=offset;
-	result = copyout(addr_ptr, (userptr_t)stackptr, offset);
-	if (result)
-	{
+	result = thread_fork(child->p_name, child, &spawn_enter, &sa, 0);
+	if (result) {
+		sem_destroy(sa.sa_done);
+		proc_destroy(child);
 		return result;
 	}
-	vaddr_t new_argv = stackptr;
-	remaining_bytes = stackptr%8; //8-byte aliging
-	stackptr-=remaining_bytes;
-	bzero((void*)stackptr, remaining_bytes);
-	
-	// Deallocate variables that were malloc-ed and are no
-	// longer needed.
-	as_destroy(existing_as);
-        for (int i=0; i<=argc; i++)
-        {
-                kfree(kernel_argv[i]);
-	}
-	kfree(kernel_argv);
-	kfree(kernel_path);
-	kfree(addr_ptr);
-	// Enter user mode
-	enter_new_process(argc, 
-			(userptr_t)new_argv,
-			//(userptr_t)stackptr,
-			 NULL,
-			stackptr, entrypoint);
-	// enter_new_process does not return, panic if reached
-	panic("enter_new_process returned unexpectedly!!!\n");
+
+	P(sa.sa_done);
+	sem_destroy(sa.sa_done);
+
+	if (sa.sa_result) {
+		/* it has exited, or is about to; collect it */
+		result = proc_wait(child->p_pid, &status);
+		KASSERT(result == 0);
+		return sa.sa_result;
+	}
+	return 0;
+}
+
+/*
+ * Apply one spawn file action to the child's file table FT. These
+ * are dup2, close and open as in file_syscalls.c, but on a table
+ * that isn't ours.
+ */
+static
+int
+spawn_fdaction(struct filetable *ft, const struct spawn_fdaction *sfa)
+{
+	struct openfile *file, *oldfile;
+	char *kpath;
+	int result;
+
+	if (!filetable_okfd(ft, sfa->sfa_fd)) {
+		return EBADF;
+	}
+
+	switch (sfa->sfa_op) {
+	    case SPAWN_FDCLOSE:
+		filetable_placeat(ft, NULL, sfa->sfa_fd, &oldfile);
+		if (oldfile == NULL) {
+			return EBADF;
+		}
+		openfile_decref(oldfile);
+		return 0;
+
+	    case SPAWN_FDDUP2:
+		if (!filetable_okfd(ft, sfa->sfa_newfd)) {
+			return EBADF;
+		}
+		result = filetable_reserve(ft, sfa->sfa_newfd);
+		if (result) {
+			return result;
+		}
+		result = filetable_get(ft, sfa->sfa_fd, &file);
+		if (result) {
+			return result;
+		}
+		if (sfa->sfa_newfd == sfa->sfa_fd) {
+			filetable_put(ft, sfa->sfa_fd, file);
+			return 0;
+		}
+		openfile_incref(file);
+		filetable_put(ft, sfa->sfa_fd, file);
+		filetable_placeat(ft, file, sfa->sfa_newfd, &oldfile);
+		if (oldfile != NULL) {
+			openfile_decref(oldfile);
+		}
+		return 0;
+
+	    case SPAWN_FDOPEN:
+		result = filetable_reserve(ft, sfa->sfa_fd);
+		if (result) {
+			return result;
+		}
+		kpath = kmalloc(PATH_MAX);
+		if (kpath == NULL) {
+			return ENOMEM;
+		}
+		result = copyinstr((const_userptr_t)sfa->sfa_path, kpath,
+				   PATH_MAX, NULL);
+		if (result == 0) {
+			result = openfile_open(kpath, sfa->sfa_flags,
+					       sfa->sfa_mode, &file);
+		}
+		kfree(kpath);
+		if (result) {
+			return result;
+		}
+		filetable_placeat(ft, file, sfa->sfa_fd, &oldfile);
+		if (oldfile != NULL) {
+			openfile_decref(oldfile);
+		}
+		return 0;
+	}
 	return EINVAL;
 }
 
+/*
+ * spawn: create a child running PATH without building a copy of our
+ * address space just to throw it away. The child gets a copy of our
+ * file table with ACTIONS applied, and a fresh address space with
+ * the program loaded into it.
+ */
+int
+sys_spawn(const_userptr_t path, userptr_t argv, const_userptr_t actions,
+	  int nactions, pid_t *retval)
+{
+	struct spawn_fdaction *sfa;
+	struct proc *child;
+	struct execargs ea;
+	char *kpath;
+	pid_t pid;
+	int i, result;
+
+	if (path == NULL || argv == NULL) {
+		return EFAULT;
+	}
+	if (nactions < 0 || nactions > SPAWN_MAXACTIONS) {
+		return EINVAL;
+	}
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (result == 0 && kpath[0] == '\0') {
+		result = EINVAL;
+	}
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+
+	result = execargs_init(&ea);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+	result = exec_copyinargs(&ea, argv);
+	if (result == 0) {
+		result = proc_fork(&child);
+	}
+	if (result) {
+		execargs_cleanup(&ea);
+		kfree(kpath);
+		return result;
+	}
+
+	if (nactions > 0) {
+		sfa = kmalloc(nactions * sizeof(*sfa));
+		if (sfa == NULL) {
+			result = ENOMEM;
+		}
+		else {
+			result = copyin(actions, sfa, nactions * sizeof(*sfa));
+			for (i=0; result == 0 && i<nactions; i++) {
+				result = spawn_fdaction(child->p_filetable,
+							&sfa[i]);
+			}
+			kfree(sfa);
+		}
+		if (result) {
+			proc_destroy(child);
+			execargs_cleanup(&ea);
+			kfree(kpath);
+			return result;
+		}
+	}
+
+	proc_addchild(curproc, child);
+	pid = child->p_pid;
+
+	result = spawn_program(child, kpath, &ea);
+	execargs_cleanup(&ea);
+	kfree(kpath);
+	if (result) {
+		return result;
+	}
+
+	*retval = pid;
+	return 0;
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * User threads: several kernel threads in one process, sharing its
+ * address space and file table, each running on a user stack its
+ * creator provides.
+ *
+ * thread_create(entry, arg, stack) starts a thread at ENTRY with ARG
+ * in its first argument register and its stack pointer at STACK, and
+ * returns its thread id. thread_exit(status) ends the calling thread;
+ * thread_join(tid, &status) waits for thread TID to do that and
+ * collects its status. The process itself lives on until its last
+ * thread is gone. _exit ends all of them: it marks the process as
+ * exiting, and the other threads notice the next time they come into
+ * the kernel (on a system call, fault, or timer interrupt) and leave.
+ * Threads asleep in the kernel are woken by _exit if they're waiting
+ * for something that might never happen (thread_join, futex_wait,
+ * and waits that use proc_sleep); those give up with EINTR and the
+ * threads leave on their way back out.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/wait.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/*
+ * Find thread TID's record. Caller holds p_thrlock.
+ */
+static
+struct uthread *
+uthread_find(struct proc *p, int tid)
+{
+	struct uthread *ut;
+
+	KASSERT(lock_do_i_hold(p->p_thrlock));
+
+	for (ut = p->p_uthreads; ut != NULL; ut = ut->ut_next) {
+		if (ut->ut_tid == tid) {
+			return ut;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Take UT off the list. Caller holds p_thrlock.
+ */
+static
+void
+uthread_unlink(struct proc *p, struct uthread *ut)
+{
+	struct uthread **utp;
+
+	KASSERT(lock_do_i_hold(p->p_thrlock));
+
+	for (utp = &p->p_uthreads; *utp != ut; utp = &(*utp)->ut_next) {
+		KASSERT(*utp != NULL);
+	}
+	*utp = ut->ut_next;
+}
+
+/*
+ * First thing a new user thread runs.
+ */
+static
+void
+uthread_enter(void *data1, unsigned long data2)
+{
+	struct proc *p = curproc;
+	struct uthread *ut = data1;
+	vaddr_t entry, arg, stack;
+
+	(void)data2;
+
+	/* UT stays put until we exit, but the list needs the lock */
+	lock_acquire(p->p_thrlock);
+	ut->ut_thread = curthread;
+	entry = ut->ut_entry;
+	arg = ut->ut_arg;
+	stack = ut->ut_stack;
+	lock_release(p->p_thrlock);
+
+	as_activate();
+
+	/* ARG goes where a new program's argc would */
+	enter_new_process((int)arg, NULL, NULL, stack, entry);
+}
+
+/*
+ * The current thread leaves its process for good, recording STATUS
+ * for thread_join if it has a record. The last thread out releases
+ * the address space and leaves the process as a zombie, with the
+ * status given to _exit, or 0 if every thread just ran out.
+ */
+void
+uthread_leave(int status)
+{
+	struct proc *p = curproc;
+	struct addrspace *as;
+	struct uthread *ut;
+	int exitstatus;
+
+	if (p->p_thrlock != NULL) {
+		lock_acquire(p->p_thrlock);
+		for (ut = p->p_uthreads; ut != NULL; ut = ut->ut_next) {
+			if (ut->ut_thread == curthread) {
+				ut->ut_thread = NULL;
+				ut->ut_status = status;
+				ut->ut_exited = true;
+				break;
+			}
+		}
+		cv_broadcast(p->p_thrcv, p->p_thrlock);
+		lock_release(p->p_thrlock);
+	}
+
+	as_deactivate();
+	if (proc_remthread(curthread) == 0) {
+		spinlock_acquire(&p->p_lock);
+		as = p->p_addrspace;
+		p->p_addrspace = NULL;
+		exitstatus = p->p_exiting ? p->p_exitstatus : _MKWAIT_EXIT(0);
+		spinlock_release(&p->p_lock);
+
+		/* a vforked child is only borrowing it */
+		if (as != NULL && !p->p_vforked) {
+			as_destroy(as);
+		}
+
+		/* become a zombie; the parent reaps us in waitpid */
+		proc_exit(p, exitstatus);
+	}
+
+	thread_exit();
+}
+
+int
+sys_thread_create(userptr_t entry, userptr_t arg, userptr_t stack,
+		  int *retval)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+	int tid, result;
+
+	if (entry == NULL || stack == NULL) {
+		return EFAULT;
+	}
+	if ((vaddr_t)stack % 8 != 0) {
+		return EINVAL;
+	}
+	if (p->p_exiting) {
+		return EINTR;
+	}
+
+	if (p->p_thrlock == NULL) {
+		/* we're the only thread, so no one else can be here */
+		p->p_thrlock = lock_create(p->p_name);
+		if (p->p_thrlock == NULL) {
+			return ENOMEM;
+		}
+		p->p_thrcv = cv_create(p->p_name);
+		if (p->p_thrcv == NULL) {
+			lock_destroy(p->p_thrlock);
+			p->p_thrlock = NULL;
+			return ENOMEM;
+		}
+	}
+
+	ut = kmalloc(sizeof(*ut));
+	if (ut == NULL) {
+		return ENOMEM;
+	}
+	ut->ut_thread = NULL;
+	ut->ut_entry = (vaddr_t)entry;
+	ut->ut_arg = (vaddr_t)arg;
+	ut->ut_stack = (vaddr_t)stack;
+	ut->ut_exited = false;
+	ut->ut_joining = false;
+	ut->ut_status = 0;
+
+	lock_acquire(p->p_thrlock);
+	tid = ut->ut_tid = p->p_nexttid++;
+	ut->ut_next = p->p_uthreads;
+	p->p_uthreads = ut;
+	lock_release(p->p_thrlock);
+
+	result = thread_fork(curthread->t_name, p, &uthread_enter, ut, 0);
+	if (result) {
+		lock_acquire(p->p_thrlock);
+		uthread_unlink(p, ut);
+		lock_release(p->p_thrlock);
+		kfree(ut);
+		return result;
+	}
+
+	*retval = tid;
+	return 0;
+}
+
+void
+sys_thread_exit(int status)
+{
+	uthread_leave(status);
+}
+
+int
+sys_thread_join(int tid, userptr_t status)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+	int exitval, result;
+
+	if (p->p_thrlock == NULL) {
+		return ESRCH;
+	}
+
+	lock_acquire(p->p_thrlock);
+	ut = uthread_find(p, tid);
+	if (ut == NULL) {
+		lock_release(p->p_thrlock);
+		return ESRCH;
+	}
+	if (ut->ut_thread == curthread) {
+		lock_release(p->p_thrlock);
+		/* joining yourself would never finish */
+		return EINVAL;
+	}
+	if (ut->ut_joining) {
+		lock_release(p->p_thrlock);
+		return EINVAL;
+	}
+
+	ut->ut_joining = true;
+	while (!ut->ut_exited && !p->p_exiting) {
+		cv_wait(p->p_thrcv, p->p_thrlock);
+	}
+	if (!ut->ut_exited) {
+		/* the process is going away; so are we, on the way out */
+		ut->ut_joining = false;
+		lock_release(p->p_thrlock);
+		return EINTR;
+	}
+
+	uthread_unlink(p, ut);
+	exitval = ut->ut_status;
+	lock_release(p->p_thrlock);
+	kfree(ut);
+
+	if (status != NULL) {
+		result = copyout(&exitval, status, sizeof(exitval));
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Console output throughput test.
+ *
+ * cwb [kbytes] writes KBYTES (default 1024) of text to con: in
+ * CWB_CHUNK-byte writes, as a program writing to stdout would, and
+ * reports how long it took. The text is lines of CWB_LINE characters
+ * so the \n to \r\n translation gets exercised too.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <uio.h>
+#include <clock.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <test.h>
+
+#define CWB_KBYTES	1024
+#define CWB_CHUNK	1024
+#define CWB_LINE	64
+
+static char cwb_buf[CWB_CHUNK];
+
+int
+conwritetest(int nargs, char **args)
+{
+	struct timespec before, after, duration;
+	struct vnode *vn;
+	struct iovec iov;
+	struct uio ku;
+	char path[8];
+	unsigned kbytes, i;
+	uint64_t nsecs;
+	int result;
+
+	kbytes = nargs > 1 ? atoi(args[1]) : CWB_KBYTES;
+	if (nargs > 2 || kbytes == 0) {
+		kprintf("Usage: cwb [kbytes]\n");
+		return EINVAL;
+	}
+
+	for (i=0; i<CWB_CHUNK; i++) {
+		cwb_buf[i] = (i % CWB_LINE == CWB_LINE - 1) ? '\n' :
+			'!' + (i / CWB_LINE + i % CWB_LINE) % ('~' - '!');
+	}
+
+	/* vfs_open destroys the string it's passed */
+	strcpy(path, "con:");
+	result = vfs_open(path, O_WRONLY, 0, &vn);
+	if (result) {
+		kprintf("conwritetest: con: %s\n", strerror(result));
+		return result;
+	}
+
+	gettime(&before);
+	for (i=0; i<kbytes * 1024 / CWB_CHUNK; i++) {
+		uio_kinit(&iov, &ku, cwb_buf, CWB_CHUNK, 0, UIO_WRITE);
+		result = VOP_WRITE(vn, &ku);
+		if (result) {
+			break;
+		}
+	}
+	gettime(&after);
+	vfs_close(vn);
+
+	if (result) {
+		kprintf("conwritetest: write: %s\n", strerror(result));
+		return result;
+	}
+
+	timespec_sub(&after, &before, &duration);
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("conwritetest: %u KB in %llu.%06lu s", kbytes,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec / 1000);
+	if (nsecs > 0) {
+		kprintf(", %llu bytes/s",
+			(unsigned long long) (kbytes * 1024ULL * 1000000000ULL
+					      / nsecs));
+	}
+	kprintf("\n");
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * File table test.
+ *
+ * ftt1 shares one file table among several threads, the way the
+ * threads of a user process share theirs. Some keep getting and
+ * putting a descriptor, as read and write do, while another keeps
+ * closing it and opening it again. Every file a getter sees must
+ * still be open, which only holds if filetable_get hands out a
+ * reference of its own.
+ *
+ * Afterwards it fills a table well past its starting size, checking
+ * that place always hands out the lowest free descriptor and that a
+ * copy of the grown table has the same files in it.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <thread.h>
+#include <synch.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <test.h>
+
+#define FTT_GETTERS	8
+#define FTT_GETLOOPS	2000
+#define FTT_REOPENS	200
+#define FTT_FD		3
+#define FTT_GROWFDS	(FT_MINSIZE * 3 + 5)
+
+static struct filetable *ftt_table;
+static volatile bool ftt_failed;
+static struct semaphore *ftt_donesem;
+
+static
+struct openfile *
+ftt_open(void)
+{
+	struct openfile *file;
+	char path[8];
+	int result;
+
+	/* openfile_open destroys the name */
+	strcpy(path, "con:");
+	result = openfile_open(path, O_RDONLY, 0, &file);
+	if (result) {
+		panic("filetabletest: opening con: failed: %s\n",
+		      strerror(result));
+	}
+	return file;
+}
+
+static
+void
+ftt_getthread(void *junk, unsigned long num)
+{
+	struct openfile *file;
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<FTT_GETLOOPS; i++) {
+		if (filetable_get(ftt_table, FTT_FD, &file)) {
+			/* caught it closed */
+			continue;
+		}
+		if (file->of_refcount < 1 || file->of_vnode == NULL) {
+			ftt_failed = true;
+		}
+		filetable_put(ftt_table, FTT_FD, file);
+	}
+	V(ftt_donesem);
+}
+
+static
+void
+ftt_reopenthread(void *junk, unsigned long num)
+{
+	struct openfile *old;
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<FTT_REOPENS; i++) {
+		filetable_placeat(ftt_table, NULL, FTT_FD, &old);
+		if (old != NULL) {
+			openfile_decref(old);
+		}
+		thread_yield();
+		filetable_placeat(ftt_table, ftt_open(), FTT_FD, &old);
+		KASSERT(old == NULL);
+	}
+	V(ftt_donesem);
+}
+
+/*
+ * Fill a fresh table with FTT_GROWFDS references to one file and poke
+ * holes in it. Returns true if all went as expected.
+ */
+static
+bool
+ftt_grow(void)
+{
+	struct filetable *ft, *copy;
+	struct openfile *file, *got, *old;
+	int i, fd;
+	bool ok = true;
+
+	ft = filetable_create();
+	if (ft == NULL) {
+		panic("filetabletest: out of memory\n");
+	}
+	file = ftt_open();
+
+	for (i=0; i<FTT_GROWFDS; i++) {
+		openfile_incref(file);
+		if (filetable_place(ft, file, &fd) || fd != i) {
+			ok = false;
+		}
+	}
+
+	/* the lowest hole gets filled first */
+	filetable_placeat(ft, NULL, FT_MINSIZE + 1, &old);
+	openfile_decref(old);
+	filetable_placeat(ft, NULL, 4, &old);
+	openfile_decref(old);
+	openfile_incref(file);
+	if (filetable_place(ft, file, &fd) || fd != 4) {
+		ok = false;
+	}
+
+	if (filetable_copy(ft, &copy)) {
+		panic("filetabletest: out of memory\n");
+	}
+	for (i=0; i<FTT_GROWFDS; i++) {
+		if (filetable_get(copy, i, &got)) {
+			if (i != FT_MINSIZE + 1) {
+				ok = false;
+			}
+			continue;
+		}
+		if (got != file || i == FT_MINSIZE + 1) {
+			ok = false;
+		}
+		filetable_put(copy, i, got);
+	}
+	if (filetable_get(copy, FTT_GROWFDS, &got) != EBADF) {
+		ok = false;
+	}
+
+	filetable_destroy(copy);
+	filetable_destroy(ft);
+	if (file->of_refcount != 1) {
+		ok = false;
+	}
+	openfile_decref(file);
+	return ok;
+}
+
+int
+filetabletest(int nargs, char **args)
+{
+	struct openfile *old;
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting file table test...\n");
+
+	ftt_donesem = sem_create("ftt_donesem", 0);
+	ftt_table = filetable_create();
+	if (ftt_donesem == NULL || ftt_table == NULL) {
+		panic("filetabletest: out of memory\n");
+	}
+	ftt_failed = false;
+	filetable_placeat(ftt_table, ftt_open(), FTT_FD, &old);
+
+	for (i=0; i<FTT_GETTERS; i++) {
+		result = thread_fork("ftt_get", NULL, ftt_getthread, NULL, i);
+		if (result) {
+			panic("filetabletest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	result = thread_fork("ftt_reopen", NULL, ftt_reopenthread, NULL, 0);
+	if (result) {
+		panic("filetabletest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	for (i=0; i<FTT_GETTERS+1; i++) {
+		P(ftt_donesem);
+	}
+
+	filetable_destroy(ftt_table);
+	ftt_table = NULL;
+	sem_destroy(ftt_donesem);
+	ftt_donesem = NULL;
+
+	if (ftt_failed) {
+		kprintf("filetabletest: FAILED: got a closed file\n");
+		return 1;
+	}
+	if (!ftt_grow()) {
+		kprintf("filetabletest: FAILED: growing the table\n");
+		return 1;
+	}
+	kprintf("File table test done.\n");
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipe test and benchmark.
+ *
+ * ppb [kbytes] pushes KBYTES (default 4096) through a pipe twice and
+ * reports the throughput of each run:
+ *
+ *   - "records": two writer threads each write PIPE_BUF-sized
+ *     records filled with one byte. Every record has to come out of
+ *     the reader whole, which checks PIPE_BUF atomicity.
+ *   - "stream": one writer writes a counting byte pattern in
+ *     PIPE_SIZE chunks, and the reader checks it comes out in order.
+ *
+ * Each run finishes by dropping the write end and checking that the
+ * reader then sees end of file.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <uio.h>
+#include <vnode.h>
+#include <pipe.h>
+#include <test.h>
+
+#define PPB_KBYTES	4096
+#define PPB_WRITERS	2
+
+static struct vnode *ppb_writevn;
+static struct semaphore *ppb_donesem;
+static size_t ppb_each;			/* bytes per writer */
+static size_t ppb_chunk;		/* bytes per write */
+static volatile bool ppb_failed;
+
+static
+void
+ppb_writer(void *junk, unsigned long num)
+{
+	struct iovec iov;
+	struct uio ku;
+	char *buf;
+	size_t done, i;
+	int result;
+
+	(void)junk;
+
+	buf = kmalloc(ppb_chunk);
+	if (buf == NULL) {
+		ppb_failed = true;
+		V(ppb_donesem);
+		return;
+	}
+
+	for (done = 0; done < ppb_each; done += ppb_chunk) {
+		if (ppb_chunk == PIPE_BUF) {
+			/* a record: one byte, which writer and which record */
+			memset(buf, (int)((num << 7) | (done / ppb_chunk % 128)),
+			       ppb_chunk);
+		}
+		else {
+			for (i=0; i<ppb_chunk; i++) {
+				buf[i] = (char)(done + i);
+			}
+		}
+		uio_kinit(&iov, &ku, buf, ppb_chunk, 0, UIO_WRITE);
+		result = VOP_WRITE(ppb_writevn, &ku);
+		if (result || ku.uio_resid != 0) {
+			ppb_failed = true;
+			break;
+		}
+	}
+
+	kfree(buf);
+	V(ppb_donesem);
+}
+
+/*
+ * Check what the reader got. For records, each read of PIPE_BUF bytes
+ * must be one whole record; for the stream, bytes must count up.
+ */
+static
+bool
+ppb_check(const char *buf, size_t len, size_t pos, bool records)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (records ? buf[i] != buf[0] : buf[i] != (char)(pos + i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static
+int
+ppb_run(const char *name, size_t total, int nwriters, size_t chunk)
+{
+	struct timespec before, after, duration;
+	struct vnode *readvn;
+	struct iovec iov;
+	struct uio ku;
+	char *buf;
+	size_t got, len;
+	uint64_t nsecs;
+	int i, result;
+
+	buf = kmalloc(chunk);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	result = pipe_create(&readvn, &ppb_writevn);
+	if (result) {
+		kfree(buf);
+		return result;
+	}
+	ppb_each = total / nwriters;
+	ppb_chunk = chunk;
+	ppb_failed = false;
+
+	gettime(&before);
+	for (i=0; i<nwriters; i++) {
+		result = thread_fork("ppb_writer", NULL, ppb_writer, NULL, i);
+		if (result) {
+			panic("pipetest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	for (got = 0; got < ppb_each * nwriters; got += len) {
+		uio_kinit(&iov, &ku, buf, chunk, 0, UIO_READ);
+		result = VOP_READ(readvn, &ku);
+		len = chunk - ku.uio_resid;
+		if (result || len == 0) {
+			ppb_failed = true;
+			break;
+		}
+		if (!ppb_check(buf, len, got, nwriters > 1) ||
+		    (nwriters > 1 && len != chunk)) {
+			ppb_failed = true;
+		}
+	}
+	gettime(&after);
+
+	for (i=0; i<nwriters; i++) {
+		P(ppb_donesem);
+	}
+
+	/* with the write end gone, the reader should see end of file */
+	VOP_DECREF(ppb_writevn);
+	ppb_writevn = NULL;
+	uio_kinit(&iov, &ku, buf, chunk, 0, UIO_READ);
+	result = VOP_READ(readvn, &ku);
+	if (result || ku.uio_resid != chunk) {
+		ppb_failed = true;
+	}
+	VOP_DECREF(readvn);
+	kfree(buf);
+
+	timespec_sub(&after, &before, &duration);
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("%-8s %lu KB in %llu.%06lu s, %llu KB/s%s\n", name,
+		(unsigned long) (got / 1024),
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec / 1000,
+		nsecs == 0 ? 0ULL :
+		(unsigned long long) (got * 1000000000ULL / 1024 / nsecs),
+		ppb_failed ? " FAILED" : "");
+	return ppb_failed ? EIO : 0;
+}
+
+int
+pipetest(int nargs, char **args)
+{
+	size_t total;
+	int result;
+
+	total = (nargs > 1 ? atoi(args[1]) : PPB_KBYTES) * 1024;
+	if (nargs > 2 || total == 0) {
+		kprintf("Usage: ppb [kbytes]\n");
+		return EINVAL;
+	}
+	/* whole records for each writer */
+	total -= total % (PPB_WRITERS * PIPE_BUF);
+
+	ppb_donesem = sem_create("ppb_donesem", 0);
+	if (ppb_donesem == NULL) {
+		return ENOMEM;
+	}
+
+	kprintf("Starting pipe test...\n");
+	result = ppb_run("records", total, PPB_WRITERS, PIPE_BUF);
+	if (result == 0) {
+		result = ppb_run("stream", total, 1, PIPE_SIZE);
+	}
+
+	sem_destroy(ppb_donesem);
+	ppb_donesem = NULL;
+
+	if (result) {
+		kprintf("pipetest: FAILED: %s\n", strerror(result));
+		return result;
+	}
+	kprintf("Pipe test done.\n");
+	return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll() and O_NONBLOCK test, on pipes.
+ *
+ * plt checks that an empty pipe reads as EAGAIN when nonblocking and
+ * isn't reported readable, that a poll with a timeout waits about as
+ * long as it should, that a poll with no timeout wakes up when
+ * another thread writes, that closing the write end shows up as
+ * POLLHUP, and that a full pipe refuses nonblocking writes and isn't
+ * reported writable.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <pipe.h>
+#include <poll.h>
+#include <test.h>
+
+#define PLT_TIMEOUT	200	/* milliseconds */
+
+static struct semaphore *plt_donesem;
+
+/*
+ * Write one byte to the pipe after giving the main thread time to go
+ * to sleep in poll.
+ */
+static
+void
+plt_writer(void *vn, unsigned long junk)
+{
+	struct iovec iov;
+	struct uio ku;
+	char ch = 'x';
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<100; i++) {
+		thread_yield();
+	}
+	uio_kinit(&iov, &ku, &ch, 1, 0, UIO_WRITE);
+	if (VOP_WRITE((struct vnode *)vn, &ku)) {
+		kprintf("plt: writer failed\n");
+	}
+	V(plt_donesem);
+}
+
+/*
+ * Do one nonblocking read or write of LEN bytes.
+ */
+static
+int
+plt_io(struct vnode *vn, char *buf, size_t len, enum uio_rw rw,
+       size_t *done)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	uio_kinit(&iov, &ku, buf, len, 0, rw);
+	ku.uio_nonblock = true;
+	result = (rw == UIO_READ) ? VOP_READ(vn, &ku) : VOP_WRITE(vn, &ku);
+	*done = len - ku.uio_resid;
+	return result;
+}
+
+static
+void
+plt_check(bool ok, const char *what, bool *failed)
+{
+	kprintf("%-40s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok) {
+		*failed = true;
+	}
+}
+
+int
+polltest(int nargs, char **args)
+{
+	struct vnode *aread, *awrite, *bread, *bwrite;
+	struct vnode *vns[3];
+	struct pollfd fds[3];
+	struct timespec before, after, duration;
+	unsigned nready, i;
+	size_t done;
+	char *buf;
+	bool failed = false;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	buf = kmalloc(PIPE_SIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	plt_donesem = sem_create("plt_donesem", 0);
+	if (plt_donesem == NULL) {
+		kfree(buf);
+		return ENOMEM;
+	}
+	result = pipe_create(&aread, &awrite);
+	if (result) {
+		goto out;
+	}
+	result = pipe_create(&bread, &bwrite);
+	if (result) {
+		goto fail_a;
+	}
+
+	kprintf("Starting poll test...\n");
+
+	vns[0] = aread;
+	vns[1] = bread;
+	vns[2] = awrite;
+	for (i=0; i<3; i++) {
+		fds[i].fd = i;
+		fds[i].events = POLLIN | POLLOUT;
+		fds[i].revents = 0;
+	}
+
+	/* empty pipes */
+	result = plt_io(aread, buf, 1, UIO_READ, &done);
+	plt_check(result == EAGAIN, "nonblocking read of empty pipe", &failed);
+	result = vfs_poll(vns, fds, 3, 0, &nready);
+	plt_check(result == 0 && nready == 1 && fds[0].revents == 0 &&
+		  fds[1].revents == 0 && fds[2].revents == POLLOUT,
+		  "poll, no timeout", &failed);
+
+	/* a timeout */
+	gettime(&before);
+	result = vfs_poll(vns, fds, 2, PLT_TIMEOUT, &nready);
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+	plt_check(result == 0 && nready == 0 &&
+		  duration.tv_sec * 1000 + duration.tv_nsec / 1000000
+		  >= PLT_TIMEOUT, "poll times out", &failed);
+
+	/* wait for a writer */
+	result = thread_fork("plt_writer", NULL, plt_writer, bwrite, 0);
+	if (result) {
+		panic("polltest: thread_fork failed: %s\n", strerror(result));
+	}
+	result = vfs_poll(vns, fds, 2, -1, &nready);
+	P(plt_donesem);
+	plt_check(result == 0 && nready == 1 && fds[0].revents == 0 &&
+		  fds[1].revents == POLLIN, "poll wakes on write", &failed);
+	result = plt_io(bread, buf, PIPE_SIZE, UIO_READ, &done);
+	plt_check(result == 0 && done == 1, "nonblocking read of 1 byte",
+		  &failed);
+
+	/* hang up */
+	VOP_DECREF(awrite);
+	vfs_reclaim_flush();
+	result = vfs_poll(vns, fds, 1, 0, &nready);
+	plt_check(result == 0 && nready == 1 && fds[0].revents == POLLHUP,
+		  "poll sees hangup", &failed);
+
+	/* fill up */
+	result = plt_io(bwrite, buf, PIPE_SIZE, UIO_WRITE, &done);
+	plt_check(result == 0 && done == PIPE_SIZE, "nonblocking fill",
+		  &failed);
+	result = plt_io(bwrite, buf, 1, UIO_WRITE, &done);
+	plt_check(result == EAGAIN, "nonblocking write of full pipe",
+		  &failed);
+	vns[0] = bwrite;
+	result = vfs_poll(vns, fds, 1, 0, &nready);
+	plt_check(result == 0 && nready == 0, "full pipe not writable",
+		  &failed);
+
+	result = 0;
+	VOP_DECREF(bwrite);
+	VOP_DECREF(bread);
+	VOP_DECREF(aread);
+	goto out;
+
+ fail_a:
+	VOP_DECREF(awrite);
+	VOP_DECREF(aread);
+ out:
+	sem_destroy(plt_donesem);
+	plt_donesem = NULL;
+	kfree(buf);
+
+	if (result == 0 && failed) {
+		result = EIO;
+	}
+	if (result) {
+		kprintf("polltest: FAILED: %s\n", strerror(result));
+		return result;
+	}
+	kprintf("Poll test done.\n");
+	return 0;
+}
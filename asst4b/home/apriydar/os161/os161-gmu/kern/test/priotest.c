@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Priority inheritance test.
+ *
+ * pri1 sets up a transitive priority inversion: a low-priority thread
+ * holds lock A; a slightly higher one holds lock B and waits for A; a
+ * high-priority thread then waits for B while a handful of
+ * medium-priority threads burn cpu. Without inheritance the high
+ * thread waits until all the medium threads are done; with it, the
+ * holders borrow the high priority, finish their short critical
+ * sections, and the high thread gets B long before the bulk work ends.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <test.h>
+
+#define NMEDIUM		4
+#define LOWWORK		200000
+#define MEDWORK		2000000
+
+static struct lock *pi_locka;
+static struct lock *pi_lockb;
+static struct semaphore *pi_readysem;
+static struct semaphore *pi_donesem;
+static volatile unsigned pi_meddone;
+static volatile unsigned pi_medatacquire;
+static volatile bool pi_failed;
+static struct timespec pi_wait;
+
+static
+void
+pi_inititems(void)
+{
+	if (pi_locka == NULL) {
+		pi_locka = lock_create("pi_locka");
+		if (pi_locka == NULL) {
+			panic("priotest: lock_create failed\n");
+		}
+	}
+	if (pi_lockb == NULL) {
+		pi_lockb = lock_create("pi_lockb");
+		if (pi_lockb == NULL) {
+			panic("priotest: lock_create failed\n");
+		}
+	}
+	if (pi_readysem == NULL) {
+		pi_readysem = sem_create("pi_readysem", 0);
+		if (pi_readysem == NULL) {
+			panic("priotest: sem_create failed\n");
+		}
+	}
+	if (pi_donesem == NULL) {
+		pi_donesem = sem_create("pi_donesem", 0);
+		if (pi_donesem == NULL) {
+			panic("priotest: sem_create failed\n");
+		}
+	}
+}
+
+static
+void
+pi_spin(unsigned long n)
+{
+	volatile unsigned long j;
+
+	for (j=0; j<n; j++);
+}
+
+/*
+ * After letting go of everything, a thread must be back at its own
+ * priority.
+ */
+static
+void
+pi_checkunboosted(void)
+{
+	if (curthread->t_effpriority != curthread->t_priority) {
+		pi_failed = true;
+	}
+}
+
+static
+void
+pi_lowthread(void *junk, unsigned long unused)
+{
+	(void)junk;
+	(void)unused;
+
+	thread_setpriority(PRI_MIN + 1);
+	lock_acquire(pi_locka);
+	V(pi_readysem);
+	pi_spin(LOWWORK);
+	lock_release(pi_locka);
+	pi_checkunboosted();
+	V(pi_donesem);
+}
+
+static
+void
+pi_chainthread(void *junk, unsigned long unused)
+{
+	(void)junk;
+	(void)unused;
+
+	thread_setpriority(PRI_MIN + 2);
+	lock_acquire(pi_lockb);
+	V(pi_readysem);
+	lock_acquire(pi_locka);
+	pi_spin(LOWWORK);
+	lock_release(pi_locka);
+	lock_release(pi_lockb);
+	pi_checkunboosted();
+	V(pi_donesem);
+}
+
+static
+void
+pi_medthread(void *junk, unsigned long unused)
+{
+	(void)junk;
+	(void)unused;
+
+	thread_setpriority(PRI_DEFAULT);
+	pi_spin(MEDWORK);
+	pi_meddone++;
+	V(pi_donesem);
+}
+
+static
+void
+pi_highthread(void *junk, unsigned long unused)
+{
+	struct timespec before, after;
+
+	(void)junk;
+	(void)unused;
+
+	thread_setpriority(PRI_MAX);
+	gettime(&before);
+	lock_acquire(pi_lockb);
+	gettime(&after);
+	pi_medatacquire = pi_meddone;
+	lock_release(pi_lockb);
+	timespec_sub(&after, &before, &pi_wait);
+	V(pi_donesem);
+}
+
+static
+void
+pi_fork(void (*func)(void *, unsigned long))
+{
+	int result;
+
+	result = thread_fork("priotest", NULL, func, NULL, 0);
+	if (result) {
+		panic("priotest: thread_fork failed: %s\n", strerror(result));
+	}
+}
+
+int
+priotest(int nargs, char **args)
+{
+	int i, oldpriority;
+
+	(void)nargs;
+	(void)args;
+
+	pi_inititems();
+	kprintf("Starting priority inheritance test...\n");
+
+	pi_meddone = 0;
+	pi_medatacquire = 0;
+	pi_failed = false;
+
+	/* stay above everyone we create until they're all started */
+	oldpriority = curthread->t_priority;
+	thread_setpriority(PRI_MAX);
+
+	pi_fork(pi_lowthread);
+	P(pi_readysem);
+	pi_fork(pi_chainthread);
+	P(pi_readysem);
+	for (i=0; i<NMEDIUM; i++) {
+		pi_fork(pi_medthread);
+	}
+	pi_fork(pi_highthread);
+
+	for (i=0; i<NMEDIUM+3; i++) {
+		P(pi_donesem);
+	}
+	thread_setpriority(oldpriority);
+
+	kprintf("High-priority thread waited %llu.%09lu seconds; "
+		"%u of %d medium threads finished first\n",
+		(unsigned long long) pi_wait.tv_sec,
+		(unsigned long) pi_wait.tv_nsec,
+		pi_medatacquire, NMEDIUM);
+
+	if (pi_medatacquire >= NMEDIUM) {
+		kprintf("High-priority thread waited behind bulk work\n");
+		pi_failed = true;
+	}
+	if (pi_failed) {
+		kprintf("Test failed\n");
+		return 0;
+	}
+
+	kprintf("Priority inheritance test done.\n");
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Process table tests.
+ *
+ * pt1 pushes several thousand processes through the process table:
+ * create a batch, look each one up by pid, destroy the batch, and
+ * repeat, timing the whole thing. With the pid bitmap and the
+ * direct-indexed table the time per process should stay flat no
+ * matter how many have come and gone.
+ *
+ * pt2 gives one process thousands of children, lets half of them
+ * exit as zombies, and then exits the parent, which has to reap the
+ * zombies and orphan the rest in one pass over its child list.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <proc.h>
+#include <synch.h>
+#include <test.h>
+
+#define PT_BATCH	256
+#define PT_ROUNDS	16
+#define PT_FANOUT	2048
+
+static struct proc *pt_procs[PT_BATCH];
+static struct proc *pt_kids[PT_FANOUT];
+static pid_t pt_kidpids[PT_FANOUT];
+
+static
+struct proc *
+pt_create(const char *name)
+{
+	struct proc *proc;
+
+	proc = proc_create_runprogram(name);
+	if (proc == NULL) {
+		panic("proctest: proc_create_runprogram failed\n");
+	}
+	return proc;
+}
+
+/*
+ * A kernel test that makes processes of its own holds an extra one
+ * for as long as it runs, so the table doesn't drop back to just the
+ * kernel process partway through; that's what tells the menu a
+ * program has finished. proctest_hold makes the extra process, or
+ * returns NULL if it can't. proctest_release destroys it again and
+ * takes back the wakeup that sends the menu.
+ */
+struct proc *
+proctest_hold(void)
+{
+	return proc_create_runprogram("test_anchor");
+}
+
+void
+proctest_release(struct proc *anchor)
+{
+	proc_destroy(anchor);
+	P(p_kern_sem);
+}
+
+int
+proctest(int nargs, char **args)
+{
+	struct timespec before, after, duration;
+	struct proc *anchor;
+	uint64_t nsecs;
+	int i, j;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting process table benchmark...\n");
+
+	anchor = proctest_hold();
+	if (anchor == NULL) {
+		panic("proctest: proctest_hold failed\n");
+	}
+
+	gettime(&before);
+	for (i=0; i<PT_ROUNDS; i++) {
+		for (j=0; j<PT_BATCH; j++) {
+			pt_procs[j] = pt_create("proctest");
+		}
+		for (j=0; j<PT_BATCH; j++) {
+			if (proc_get_process(pt_procs[j]->p_pid) !=
+			    pt_procs[j]) {
+				panic("proctest: pid %d looked up wrong\n",
+				      pt_procs[j]->p_pid);
+			}
+		}
+		for (j=0; j<PT_BATCH; j++) {
+			proc_destroy(pt_procs[j]);
+			pt_procs[j] = NULL;
+		}
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+
+	proctest_release(anchor);
+
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("%d processes created, looked up and destroyed in "
+		"%llu.%09lu seconds (%llu usec each)\n",
+		PT_ROUNDS * PT_BATCH,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec,
+		(unsigned long long) (nsecs / 1000 / (PT_ROUNDS * PT_BATCH)));
+	kprintf("Process table benchmark done.\n");
+	return 0;
+}
+
+int
+proctest2(int nargs, char **args)
+{
+	struct timespec before, after, duration;
+	struct proc *anchor, *parent;
+	int i;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting process fan-out test...\n");
+
+	anchor = proctest_hold();
+	if (anchor == NULL) {
+		panic("proctest: proctest_hold failed\n");
+	}
+
+	parent = pt_create("pt_parent");
+	for (i=0; i<PT_FANOUT; i++) {
+		pt_kids[i] = pt_create("pt_kid");
+		pt_kidpids[i] = pt_kids[i]->p_pid;
+		proc_addchild(parent, pt_kids[i]);
+	}
+
+	/* half the children exit and wait around as zombies */
+	for (i=0; i<PT_FANOUT; i+=2) {
+		proc_exit(pt_kids[i], 0);
+		pt_kids[i] = NULL;
+	}
+
+	gettime(&before);
+	proc_exit(parent, 0);
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+
+	for (i=0; i<PT_FANOUT; i++) {
+		if (i % 2 == 0) {
+			if (proc_get_process(pt_kidpids[i]) != NULL) {
+				panic("proctest: zombie %d not reaped\n",
+				      pt_kidpids[i]);
+			}
+		}
+		else {
+			if (pt_kids[i]->p_parent != NULL ||
+			    pt_kids[i]->p_sibnext != NULL ||
+			    pt_kids[i]->p_sibprev != NULL) {
+				panic("proctest: child %d not orphaned\n",
+				      pt_kidpids[i]);
+			}
+			proc_destroy(pt_kids[i]);
+			pt_kids[i] = NULL;
+		}
+	}
+
+	proctest_release(anchor);
+
+	kprintf("Parent with %d children (%d zombies) exited in "
+		"%llu.%09lu seconds\n", PT_FANOUT, PT_FANOUT / 2,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec);
+	kprintf("Process fan-out test done.\n");
+	return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Reader-writer lock test code.
+ *
+ * rwt1 checks that writers really exclude readers and each other, and
+ * then times a read-mostly workload with the same number of threads
+ * going through an ordinary lock and through the rwlock, so the
+ * difference in read throughput can be seen directly.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NREADERS	16
+#define NREADLOOPS	400
+#define NWRITELOOPS	20
+#define READWORK	200
+
+static volatile unsigned long rwval1;
+static volatile unsigned long rwval2;
+static volatile bool rwfailed;
+static struct rwlock *testrw;
+static struct lock *testrwlock;
+static struct semaphore *rwdonesem;
+
+static
+void
+rw_inititems(void)
+{
+	if (testrw == NULL) {
+		testrw = rwlock_create("testrw");
+		if (testrw == NULL) {
+			panic("rwtest: rwlock_create failed\n");
+		}
+	}
+	if (testrwlock == NULL) {
+		testrwlock = lock_create("testrwlock");
+		if (testrwlock == NULL) {
+			panic("rwtest: lock_create failed\n");
+		}
+	}
+	if (rwdonesem == NULL) {
+		rwdonesem = sem_create("rwdonesem", 0);
+		if (rwdonesem == NULL) {
+			panic("rwtest: sem_create failed\n");
+		}
+	}
+}
+
+/*
+ * Look at the shared values for a little while. A writer always
+ * stores them as a matched pair, so seeing them disagree means a
+ * writer got in while we held the lock for reading.
+ */
+static
+void
+rw_readwork(void)
+{
+	volatile int j;
+	unsigned long v1;
+
+	v1 = rwval1;
+	for (j=0; j<READWORK; j++);
+	if (rwval2 != v1 * 2) {
+		rwfailed = true;
+	}
+}
+
+static
+void
+rw_readthread(void *junk, unsigned long uselock)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NREADLOOPS; i++) {
+		if (uselock) {
+			lock_acquire(testrwlock);
+			rw_readwork();
+			lock_release(testrwlock);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			rw_readwork();
+			rwlock_release_read(testrw);
+		}
+	}
+	V(rwdonesem);
+}
+
+static
+void
+rw_writethread(void *junk, unsigned long uselock)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NWRITELOOPS; i++) {
+		if (uselock) {
+			lock_acquire(testrwlock);
+		}
+		else if (i % 2 == 0) {
+			rwlock_acquire_write(testrw);
+		}
+		else {
+			/* exercise the upgrade path half the time */
+			rwlock_acquire_read(testrw);
+			rwlock_upgrade(testrw);
+		}
+
+		rwval1 = rwval1 + 1;
+		thread_yield();
+		rwval2 = rwval1 * 2;
+
+		if (uselock) {
+			lock_release(testrwlock);
+		}
+		else {
+			/* and check that a downgrade still keeps writers out */
+			rwlock_downgrade(testrw);
+			rw_readwork();
+			rwlock_release_read(testrw);
+		}
+		thread_yield();
+	}
+	V(rwdonesem);
+}
+
+/*
+ * Run NREADERS readers and one writer, and return how long it took.
+ */
+static
+void
+rw_runone(unsigned long uselock, struct timespec *duration)
+{
+	struct timespec before, after;
+	int i, result;
+
+	gettime(&before);
+
+	for (i=0; i<NREADERS; i++) {
+		result = thread_fork("rwtest", NULL, rw_readthread,
+				     NULL, uselock);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	result = thread_fork("rwtest", NULL, rw_writethread, NULL, uselock);
+	if (result) {
+		panic("rwtest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	for (i=0; i<NREADERS+1; i++) {
+		P(rwdonesem);
+	}
+
+	gettime(&after);
+	timespec_sub(&after, &before, duration);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	struct timespec locktime, rwtime;
+
+	(void)nargs;
+	(void)args;
+
+	rw_inititems();
+	kprintf("Starting rwlock test...\n");
+
+	rwval1 = 0;
+	rwval2 = 0;
+	rwfailed = false;
+
+	rw_runone(1, &locktime);
+	rw_runone(0, &rwtime);
+
+	kprintf("%d readers x %d reads, plain lock: %llu.%09lu seconds\n",
+		NREADERS, NREADLOOPS,
+		(unsigned long long) locktime.tv_sec,
+		(unsigned long) locktime.tv_nsec);
+	kprintf("%d readers x %d reads, rwlock:     %llu.%09lu seconds\n",
+		NREADERS, NREADLOOPS,
+		(unsigned long long) rwtime.tv_sec,
+		(unsigned long) rwtime.tv_nsec);
+
+	if (rwfailed) {
+		kprintf("Reader saw a half-finished write\n");
+		kprintf("Test failed\n");
+		return 0;
+	}
+
+	kprintf("rwlock test done.\n");
+	return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Copy benchmark.
+ *
+ * sfb src dst copies SRC to DST twice and reports how long each copy
+ * took:
+ *
+ *   - "read/write": the way cp does it, SFB_BUFSIZE bytes at a time.
+ *     Each chunk is read into one buffer and copied over to another
+ *     before being written, standing in for the copyout to the
+ *     user's buffer and the copyin back.
+ *   - "sendfile": one call to openfile_sendfile, as the sendfile
+ *     system call makes, which goes through a kernel buffer.
+ *
+ * Both copies are checked for size.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <stat.h>
+#include <lib.h>
+#include <clock.h>
+#include <uio.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <test.h>
+
+#define SFB_BUFSIZE	4096
+
+/*
+ * Open PATH, which isn't destroyed.
+ */
+static
+int
+sfb_open(const char *path, int flags, struct openfile **ret)
+{
+	char *copy;
+	int result;
+
+	copy = kstrdup(path);
+	if (copy == NULL) {
+		return ENOMEM;
+	}
+	result = openfile_open(copy, flags, 0664, ret);
+	kfree(copy);
+	return result;
+}
+
+/*
+ * Copy IN to OUT the read/write way. Returns the number of bytes.
+ */
+static
+int
+sfb_readwrite(struct openfile *in, struct openfile *out, size_t *done)
+{
+	struct iovec iov;
+	struct uio ku;
+	char *kbuf, *ubuf;
+	size_t len;
+	int result;
+
+	kbuf = kmalloc(SFB_BUFSIZE);
+	ubuf = kmalloc(SFB_BUFSIZE);
+	if (kbuf == NULL || ubuf == NULL) {
+		kfree(kbuf);
+		kfree(ubuf);
+		return ENOMEM;
+	}
+
+	*done = 0;
+	while (1) {
+		uio_kinit(&iov, &ku, kbuf, SFB_BUFSIZE, 0, UIO_READ);
+		result = openfile_readwrite(in, &ku);
+		len = SFB_BUFSIZE - ku.uio_resid;
+		if (result || len == 0) {
+			break;
+		}
+		memcpy(ubuf, kbuf, len);
+		memcpy(kbuf, ubuf, len);
+		uio_kinit(&iov, &ku, kbuf, len, 0, UIO_WRITE);
+		result = openfile_readwrite(out, &ku);
+		if (result) {
+			break;
+		}
+		if (ku.uio_resid != 0) {
+			result = EIO;
+			break;
+		}
+		*done += len;
+	}
+
+	kfree(kbuf);
+	kfree(ubuf);
+	return result;
+}
+
+/*
+ * Copy SRC to DST one way or the other and print how it went.
+ */
+static
+int
+sfb_pass(const char *name, const char *src, const char *dst, bool sendfile,
+	 off_t size)
+{
+	struct timespec before, after, duration;
+	struct openfile *in, *out;
+	uint64_t nsecs;
+	size_t done;
+	int result;
+
+	result = sfb_open(src, O_RDONLY, &in);
+	if (result) {
+		return result;
+	}
+	result = sfb_open(dst, O_WRONLY|O_CREAT|O_TRUNC, &out);
+	if (result) {
+		openfile_decref(in);
+		return result;
+	}
+
+	gettime(&before);
+	if (sendfile) {
+		result = openfile_sendfile(out, in, NULL, size, &done);
+	}
+	else {
+		result = sfb_readwrite(in, out, &done);
+	}
+	gettime(&after);
+
+	openfile_decref(out);
+	openfile_decref(in);
+	if (result) {
+		return result;
+	}
+	if ((off_t)done != size) {
+		kprintf("sfb: %s copied %lu of %llu bytes\n", name,
+			(unsigned long) done, (unsigned long long) size);
+		return EIO;
+	}
+
+	timespec_sub(&after, &before, &duration);
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("%-10s %lu bytes in %llu.%06lu s, %llu KB/s\n", name,
+		(unsigned long) done,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec / 1000,
+		nsecs == 0 ? 0ULL :
+		(unsigned long long) (done * 1000000000ULL / 1024 / nsecs));
+	return 0;
+}
+
+int
+sendfiletest(int nargs, char **args)
+{
+	struct openfile *in;
+	struct stat st;
+	int result;
+
+	if (nargs != 3) {
+		kprintf("Usage: sfb src dst\n");
+		return EINVAL;
+	}
+
+	result = sfb_open(args[1], O_RDONLY, &in);
+	if (result == 0) {
+		result = VOP_STAT(in->of_vnode, &st);
+		openfile_decref(in);
+	}
+	if (result) {
+		kprintf("sfb: %s: %s\n", args[1], strerror(result));
+		return result;
+	}
+
+	kprintf("Starting copy benchmark...\n");
+	result = sfb_pass("read/write", args[1], args[2], false, st.st_size);
+	if (result == 0) {
+		result = sfb_pass("sendfile", args[1], args[2], true,
+				  st.st_size);
+	}
+	if (result) {
+		kprintf("sfb: %s\n", strerror(result));
+		return result;
+	}
+	kprintf("Copy benchmark done.\n");
+	return 0;
+}
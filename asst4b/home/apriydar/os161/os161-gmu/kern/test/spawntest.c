@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Spawn benchmark.
+ *
+ * spb [program [count]] starts PROGRAM (default /bin/true) COUNT times
+ * through the same path the spawn() system call uses, waiting for
+ * each one to exit, and reports how many it managed per second. It
+ * is the in-kernel counterpart of running forktest: no address space
+ * is copied, so what's left is process setup and loading the ELF.
+ * After the first run the program's headers should come from the
+ * load_elf cache; the hit and miss counts are printed at the end.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <filetable.h>
+#include <syscall.h>
+#include <test.h>
+
+#define SP_PROG		"/bin/true"
+#define SP_COUNT	100
+
+int
+spawntest(int nargs, char **args)
+{
+	struct timespec before, after, duration;
+	struct proc *anchor, *child;
+	const char *prog;
+	struct execargs ea;
+	char *path, *argv[1];
+	uint64_t nsecs;
+	unsigned hits0, misses0, hits, misses;
+	pid_t pid;
+	int count, i, status, result;
+
+	prog = nargs > 1 ? args[1] : SP_PROG;
+	count = nargs > 2 ? atoi(args[2]) : SP_COUNT;
+	if (count <= 0) {
+		kprintf("Usage: spb [program [count]]\n");
+		return EINVAL;
+	}
+
+	kprintf("Starting spawn benchmark: %d runs of %s...\n", count, prog);
+
+	result = execargs_init(&ea);
+	if (result) {
+		return result;
+	}
+	argv[0] = (char *)prog;
+
+	anchor = proctest_hold();
+	if (anchor == NULL) {
+		execargs_cleanup(&ea);
+		return ENOMEM;
+	}
+
+	result = 0;
+	load_elf_stats(&hits0, &misses0);
+	gettime(&before);
+	for (i=0; i<count; i++) {
+		result = proc_fork(&child);
+		if (result) {
+			break;
+		}
+		/* we have no files of our own to hand down */
+		if (child->p_filetable == NULL) {
+			child->p_filetable = filetable_create();
+			if (child->p_filetable == NULL) {
+				proc_destroy(child);
+				result = ENOMEM;
+				break;
+			}
+		}
+		proc_addchild(curproc, child);
+		pid = child->p_pid;
+
+		/* spawn_program uses up both of these */
+		path = kstrdup(prog);
+		result = path == NULL ? ENOMEM :
+			execargs_kernel(&ea, 1, argv);
+		if (result == 0) {
+			result = spawn_program(child, path, &ea);
+		}
+		else {
+			proc_destroy(child);
+		}
+		kfree(path);
+		if (result) {
+			break;
+		}
+
+		result = proc_wait(pid, &status);
+		if (result) {
+			break;
+		}
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+	load_elf_stats(&hits, &misses);
+	execargs_cleanup(&ea);
+
+	proctest_release(anchor);
+
+	if (result) {
+		kprintf("spawntest: run %d of %s: %s\n", i, prog,
+			strerror(result));
+		return result;
+	}
+
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("%d spawns in %llu.%09lu seconds (%llu usec each, "
+		"%llu per second)\n", count,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec,
+		(unsigned long long) (nsecs / 1000 / count),
+		(unsigned long long) (nsecs ? 1000000000ULL * count / nsecs : 0));
+	kprintf("ELF header cache: %u hits, %u misses\n",
+		hits - hits0, misses - misses0);
+	kprintf("Spawn benchmark done.\n");
+	return 0;
+}
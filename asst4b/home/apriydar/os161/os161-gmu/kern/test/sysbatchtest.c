@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * System call overhead benchmark.
+ *
+ * sbb [count] makes COUNT getpid calls three ways and reports the
+ * time per call:
+ *
+ *   - "direct": calling sys_getpid, for the cost of the work itself.
+ *   - "syscall": through syscall() with a trapframe, as the trap
+ *     handler does; the difference is dispatch and trapframe
+ *     handling. (The exception entry and exit themselves can't be
+ *     timed from inside the kernel.)
+ *   - "batch": SBB_BATCH calls at a time through syscall_batch, for
+ *     the per-call cost once the trap is shared.
+ *
+ * It also checks that a batch stops at a failing call when asked to
+ * and writes back results. The descriptors have to be in user memory,
+ * so the test borrows an address space for the kernel process while
+ * it runs; it's made once and kept, since dumbvm can't give the
+ * memory back anyway.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <kern/sysbatch.h>
+#include <lib.h>
+#include <clock.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <mips/trapframe.h>
+#include <syscall.h>
+#include <test.h>
+
+#define SBB_COUNT	20000
+#define SBB_BATCH	64
+
+static struct addrspace *sbb_as;
+
+/*
+ * Set up (the first time) and switch to the borrowed address space.
+ * The descriptors go at the top of its stack.
+ */
+static
+int
+sbb_setas(struct addrspace **oldas, userptr_t *descs)
+{
+	vaddr_t stackptr;
+	int result;
+
+	if (sbb_as == NULL) {
+		sbb_as = as_create();
+		if (sbb_as == NULL) {
+			return ENOMEM;
+		}
+		/* dumbvm wants two regions */
+		result = as_define_region(sbb_as, 0x400000, PAGE_SIZE, 1, 1, 0);
+		if (result == 0) {
+			result = as_define_region(sbb_as, 0x500000, PAGE_SIZE,
+						  1, 1, 0);
+		}
+		if (result == 0) {
+			result = as_prepare_load(sbb_as);
+		}
+		if (result == 0) {
+			result = as_complete_load(sbb_as);
+		}
+		if (result) {
+			as_destroy(sbb_as);
+			sbb_as = NULL;
+			return result;
+		}
+	}
+	as_define_stack(sbb_as, &stackptr);
+
+	*oldas = proc_setas(sbb_as);
+	as_activate();
+	*descs = (userptr_t)(stackptr - SBB_BATCH * sizeof(struct syscall_desc));
+	return 0;
+}
+
+static
+void
+sbb_report(const char *name, unsigned count, struct timespec *before,
+	   struct timespec *after)
+{
+	struct timespec duration;
+	uint64_t nsecs;
+
+	timespec_sub(after, before, &duration);
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("%-8s %u calls in %llu.%06lu s, %llu ns/call\n", name, count,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec / 1000,
+		(unsigned long long) (nsecs / count));
+}
+
+/*
+ * Run a batch of N descriptors from DESCS through syscall().
+ */
+static
+int
+sbb_batch(userptr_t descs, unsigned n, int flags, int32_t *ran)
+{
+	struct trapframe tf;
+
+	bzero(&tf, sizeof(tf));
+	tf.tf_v0 = SYS_syscall_batch;
+	tf.tf_a0 = (uint32_t)descs;
+	tf.tf_a1 = n;
+	tf.tf_a2 = flags;
+	syscall(&tf);
+	*ran = tf.tf_v0;
+	return tf.tf_a3 ? (int)tf.tf_v0 : 0;
+}
+
+/*
+ * Check a short batch: getpid, something that can't be batched,
+ * getpid.
+ */
+static
+bool
+sbb_check(userptr_t descs)
+{
+	struct syscall_desc sd[3];
+	int32_t ran;
+	int i, result;
+
+	bzero(sd, sizeof(sd));
+	sd[0].sd_callno = SYS_getpid;
+	sd[1].sd_callno = SYS_fork;
+	sd[2].sd_callno = SYS_getpid;
+	for (i=0; i<3; i++) {
+		sd[i].sd_error = -1;
+	}
+
+	result = copyout(sd, descs, sizeof(sd));
+	if (result == 0) {
+		result = sbb_batch(descs, 3, SYSBATCH_STOPONERR, &ran);
+	}
+	if (result == 0) {
+		result = copyin(descs, sd, sizeof(sd));
+	}
+	if (result || ran != 2 ||
+	    sd[0].sd_error != 0 || sd[0].sd_retval != curproc->p_pid ||
+	    sd[1].sd_error != EINVAL || sd[2].sd_error != -1) {
+		return false;
+	}
+
+	result = sbb_batch(descs, 3, 0, &ran);
+	if (result == 0) {
+		result = copyin(descs, sd, sizeof(sd));
+	}
+	if (result || ran != 3 || sd[2].sd_error != 0) {
+		return false;
+	}
+	return true;
+}
+
+int
+sysbatchtest(int nargs, char **args)
+{
+	struct syscall_desc sd[SBB_BATCH];
+	struct timespec before, after;
+	struct addrspace *oldas;
+	struct trapframe tf;
+	userptr_t descs;
+	unsigned count, i;
+	int32_t ran;
+	pid_t pid;
+	bool ok;
+	int result;
+
+	count = nargs > 1 ? atoi(args[1]) : SBB_COUNT;
+	if (nargs > 2 || count < SBB_BATCH) {
+		kprintf("Usage: sbb [count]\n");
+		return EINVAL;
+	}
+	count -= count % SBB_BATCH;
+
+	result = sbb_setas(&oldas, &descs);
+	if (result) {
+		kprintf("sysbatchtest: %s\n", strerror(result));
+		return result;
+	}
+
+	kprintf("Starting syscall batch test...\n");
+
+	gettime(&before);
+	for (i=0; i<count; i++) {
+		sys_getpid(&pid);
+	}
+	gettime(&after);
+	sbb_report("direct", count, &before, &after);
+
+	gettime(&before);
+	for (i=0; i<count; i++) {
+		bzero(&tf, sizeof(tf));
+		tf.tf_v0 = SYS_getpid;
+		syscall(&tf);
+	}
+	gettime(&after);
+	sbb_report("syscall", count, &before, &after);
+
+	bzero(sd, sizeof(sd));
+	for (i=0; i<SBB_BATCH; i++) {
+		sd[i].sd_callno = SYS_getpid;
+	}
+	result = copyout(sd, descs, sizeof(sd));
+	gettime(&before);
+	for (i=0; i<count && result == 0; i += SBB_BATCH) {
+		result = sbb_batch(descs, SBB_BATCH, 0, &ran);
+	}
+	gettime(&after);
+	if (result == 0) {
+		sbb_report("batch", count, &before, &after);
+	}
+
+	ok = result == 0 && sbb_check(descs);
+
+	proc_setas(oldas);
+	as_activate();
+
+	if (!ok) {
+		kprintf("sysbatchtest: FAILED%s%s\n", result ? ": " : "",
+			result ? strerror(result) : "");
+		return result ? result : EIO;
+	}
+	kprintf("Syscall batch test done.\n");
+	return 0;
+}
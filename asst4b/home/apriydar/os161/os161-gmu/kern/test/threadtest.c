@@ -32,11 +32,13 @@
  */
 #include <types.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
 
 #define NTHREADS  8
+#define NBENCHROUNDS  64
 
 static struct semaphore *tsem = NULL;
 
@@ -144,3 +146,60 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+static
+void
+nullthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+/*
+ * Thread create/join benchmark: fork NTHREADS threads that do nothing
+ * but exit, wait for them all, and repeat. This is almost entirely
+ * thread_fork and thread_exit overhead, which is what the per-cpu
+ * thread cache is meant to cut down.
+ */
+int
+threadtest4(int nargs, char **args)
+{
+	struct timespec before, after, duration;
+	uint64_t nsecs;
+	int i, j, result;
+
+	(void)nargs;
+	(void)args;
+
+	init_sem();
+	kprintf("Starting thread create/join benchmark...\n");
+
+	gettime(&before);
+	for (i=0; i<NBENCHROUNDS; i++) {
+		for (j=0; j<NTHREADS; j++) {
+			result = thread_fork("threadbench", NULL,
+					     nullthread, NULL, j);
+			if (result) {
+				panic("threadtest: thread_fork failed %s)\n",
+				      strerror(result));
+			}
+		}
+		for (j=0; j<NTHREADS; j++) {
+			P(tsem);
+		}
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &duration);
+
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	kprintf("%d threads created and joined in %llu.%09lu seconds "
+		"(%llu usec each)\n", NBENCHROUNDS * NTHREADS,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec,
+		(unsigned long long) (nsecs / 1000 / (NBENCHROUNDS * NTHREADS)));
+	kprintf("Thread create/join benchmark done.\n");
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Record writer benchmark.
+ *
+ * wvb file [records] writes RECORDS records, each a short header and
+ * a payload, to FILE three ways: a write per header and a write per
+ * payload, one writev per record, and one writev per batch of
+ * records. Each call goes through openfile_readwrite, as read, write,
+ * readv and writev do, so it pays for the offset lock and a trip
+ * through the VFS once per call. It reports the number of calls, the
+ * time taken and the throughput of each, then removes the file.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <clock.h>
+#include <uio.h>
+#include <vfs.h>
+#include <openfile.h>
+#include <test.h>
+
+#define WVB_RECORDS	2000
+#define WVB_HDRLEN	16
+#define WVB_BODYLEN	240
+#define WVB_BATCH	32	/* records per writev when batching */
+
+static char wvb_hdr[WVB_HDRLEN];
+static char wvb_body[WVB_BODYLEN];
+
+/*
+ * Write NRECS records to FILE, PERCALL records per call, using
+ * separate calls for header and payload if SPLIT is set. Returns the
+ * number of calls made in *NCALLS.
+ */
+static
+int
+wvb_write(struct openfile *file, int nrecs, int percall, bool split,
+	  unsigned *ncalls)
+{
+	struct iovec iov[2 * WVB_BATCH];
+	struct uio ku;
+	int i, j, n, result;
+
+	KASSERT(percall <= WVB_BATCH);
+
+	*ncalls = 0;
+	for (i=0; i<nrecs; i += n) {
+		n = nrecs - i < percall ? nrecs - i : percall;
+		for (j=0; j<n; j++) {
+			iov[2*j].iov_kbase = wvb_hdr;
+			iov[2*j].iov_len = WVB_HDRLEN;
+			iov[2*j+1].iov_kbase = wvb_body;
+			iov[2*j+1].iov_len = WVB_BODYLEN;
+		}
+		if (split) {
+			for (j=0; j<2*n; j++) {
+				uio_kinitv(&iov[j], 1, &ku, 0, UIO_WRITE);
+				result = openfile_readwrite(file, &ku);
+				if (result) {
+					return result;
+				}
+				(*ncalls)++;
+			}
+		}
+		else {
+			uio_kinitv(iov, 2*n, &ku, 0, UIO_WRITE);
+			result = openfile_readwrite(file, &ku);
+			if (result) {
+				return result;
+			}
+			(*ncalls)++;
+		}
+		if (ku.uio_resid != 0) {
+			return EIO;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Run one pass over a freshly truncated FILENAME and print the
+ * results.
+ */
+static
+int
+wvb_pass(const char *name, const char *filename, int nrecs, int percall,
+	 bool split)
+{
+	struct timespec before, after, duration;
+	struct openfile *file;
+	char *path;
+	uint64_t nsecs, bytes;
+	unsigned ncalls;
+	int result;
+
+	/* openfile_open destroys the name */
+	path = kstrdup(filename);
+	if (path == NULL) {
+		return ENOMEM;
+	}
+	result = openfile_open(path, O_WRONLY|O_CREAT|O_TRUNC, 0664, &file);
+	kfree(path);
+	if (result) {
+		return result;
+	}
+
+	gettime(&before);
+	result = wvb_write(file, nrecs, percall, split, &ncalls);
+	gettime(&after);
+	openfile_decref(file);
+	if (result) {
+		return result;
+	}
+
+	timespec_sub(&after, &before, &duration);
+	nsecs = duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+	bytes = (uint64_t)nrecs * (WVB_HDRLEN + WVB_BODYLEN);
+	kprintf("%-16s %6u calls in %llu.%06lu s, %llu KB/s\n", name, ncalls,
+		(unsigned long long) duration.tv_sec,
+		(unsigned long) duration.tv_nsec / 1000,
+		nsecs == 0 ? 0ULL :
+		(unsigned long long) (bytes * 1000000000ULL / 1024 / nsecs));
+	return 0;
+}
+
+int
+writevtest(int nargs, char **args)
+{
+	char *path;
+	int nrecs, result;
+
+	if (nargs < 2 || nargs > 3) {
+		kprintf("Usage: wvb file [records]\n");
+		return EINVAL;
+	}
+	nrecs = nargs > 2 ? atoi(args[2]) : WVB_RECORDS;
+	if (nrecs <= 0) {
+		kprintf("Usage: wvb file [records]\n");
+		return EINVAL;
+	}
+
+	memset(wvb_hdr, 'h', sizeof(wvb_hdr));
+	memset(wvb_body, 'b', sizeof(wvb_body));
+
+	kprintf("Starting record writer benchmark: %d records of %d bytes\n",
+		nrecs, WVB_HDRLEN + WVB_BODYLEN);
+
+	result = wvb_pass("write+write", args[1], nrecs, 1, true);
+	if (result == 0) {
+		result = wvb_pass("writev", args[1], nrecs, 1, false);
+	}
+	if (result == 0) {
+		result = wvb_pass("writev batched", args[1], nrecs, WVB_BATCH,
+				  false);
+	}
+
+	path = kstrdup(args[1]);
+	if (path != NULL) {
+		vfs_remove(path);
+		kfree(path);
+	}
+
+	if (result) {
+		kprintf("writevtest: %s: %s\n", args[1], strerror(result));
+		return result;
+	}
+	kprintf("Record writer benchmark done.\n");
+	return 0;
+}
@@ -32,6 +32,7 @@
 #include <cpu.h>
 #include <wchan.h>
 #include <clock.h>
+#include <poll.h>
 #include <thread.h>
 #include <current.h>
 
@@ -97,6 +98,20 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+
+	/* charge the tick to whoever we interrupted */
+	if (curthread->t_intrfromuser) {
+		curthread->t_usage.cu_utime++;
+	}
+	else {
+		curthread->t_usage.cu_stime++;
+	}
+
+	/* let poll()s with a timeout check the time; once is enough */
+	if (curcpu->c_number == 0) {
+		poll_tick();
+	}
+
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
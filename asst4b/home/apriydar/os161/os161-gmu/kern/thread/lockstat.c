@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention statistics. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <lockstat.h>
+
+/*
+ * The table of entries. This is a fixed-size static array so that
+ * looking things up never calls kmalloc (which uses a spinlock and
+ * is itself called from lock_create) and works before kmalloc is up.
+ *
+ * lockstat_lock protects everything here. It is not named, so taking
+ * it does not itself go through the statistics code.
+ */
+static struct lockstat lockstats[LOCKSTAT_MAX];
+static unsigned numlockstats;
+static struct spinlock lockstat_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Set once the clock device exists; gettime() panics before that.
+ */
+static volatile bool lockstat_timing;
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_timing = true;
+}
+
+struct lockstat *
+lockstat_get(const char *name, int kind)
+{
+	struct lockstat *ls;
+	char key[LOCKSTAT_NAMELEN];
+	size_t len;
+	unsigned i;
+
+	KASSERT(name != NULL);
+
+	/* Cut the name down to what we store. */
+	len = strlen(name);
+	if (len > sizeof(key)-1) {
+		len = sizeof(key)-1;
+	}
+	memcpy(key, name, len);
+	key[len] = 0;
+
+	spinlock_acquire(&lockstat_lock);
+	for (i=0; i<numlockstats; i++) {
+		ls = &lockstats[i];
+		if (ls->ls_kind == kind && !strcmp(ls->ls_name, key)) {
+			spinlock_release(&lockstat_lock);
+			return ls;
+		}
+	}
+	if (numlockstats == LOCKSTAT_MAX) {
+		/* Full; this one doesn't get counted. */
+		spinlock_release(&lockstat_lock);
+		return NULL;
+	}
+	ls = &lockstats[numlockstats++];
+	strcpy(ls->ls_name, key);
+	ls->ls_kind = kind;
+	ls->ls_acquires = 0;
+	ls->ls_contended = 0;
+	ls->ls_waitnsec = 0;
+	ls->ls_maxholdnsec = 0;
+	spinlock_release(&lockstat_lock);
+
+	return ls;
+}
+
+void
+lockstat_spinlock_init(struct spinlock *splk, const char *name)
+{
+	splk->splk_stat = lockstat_get(name, LOCKSTAT_SPINLOCK);
+}
+
+uint64_t
+lockstat_now(void)
+{
+	struct timespec ts;
+
+	if (!lockstat_timing) {
+		return 0;
+	}
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t
+lockstat_acquired(struct lockstat *ls, bool contended, uint64_t waitstart)
+{
+	uint64_t now;
+
+	if (ls == NULL || !lockstat_timing) {
+		return 0;
+	}
+
+	now = lockstat_now();
+
+	spinlock_acquire(&lockstat_lock);
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+		/* waitstart is 0 if timing came on while we were waiting */
+		if (waitstart != 0 && now > waitstart) {
+			ls->ls_waitnsec += now - waitstart;
+		}
+	}
+	spinlock_release(&lockstat_lock);
+
+	return now;
+}
+
+void
+lockstat_released(struct lockstat *ls, uint64_t acquired)
+{
+	uint64_t now;
+
+	if (ls == NULL || acquired == 0) {
+		/* not counted when it was acquired */
+		return;
+	}
+
+	now = lockstat_now();
+
+	spinlock_acquire(&lockstat_lock);
+	if (now > acquired && now - acquired > ls->ls_maxholdnsec) {
+		ls->ls_maxholdnsec = now - acquired;
+	}
+	spinlock_release(&lockstat_lock);
+}
+
+void
+lockstat_reset(void)
+{
+	unsigned i;
+
+	spinlock_acquire(&lockstat_lock);
+	for (i=0; i<numlockstats; i++) {
+		lockstats[i].ls_acquires = 0;
+		lockstats[i].ls_contended = 0;
+		lockstats[i].ls_waitnsec = 0;
+		lockstats[i].ls_maxholdnsec = 0;
+	}
+	spinlock_release(&lockstat_lock);
+}
+
+/*
+ * Return true if A should be printed before B.
+ */
+static
+bool
+lockstat_before(const struct lockstat *a, const struct lockstat *b, int sortby)
+{
+	switch (sortby) {
+	    case LOCKSTAT_BYACQUIRES:
+		return a->ls_acquires > b->ls_acquires;
+	    case LOCKSTAT_BYCONTENDED:
+		return a->ls_contended > b->ls_contended;
+	    case LOCKSTAT_BYHOLD:
+		return a->ls_maxholdnsec > b->ls_maxholdnsec;
+	    case LOCKSTAT_BYWAIT:
+	    default:
+		return a->ls_waitnsec > b->ls_waitnsec;
+	}
+}
+
+/*
+ * Snapshot for lockstat_print. It's too big for the stack, and as a
+ * kmalloc it would take several pages, which dumbvm never gives back;
+ * a static one is fine since only the menu thread prints.
+ */
+static struct lockstat lockstat_snap[LOCKSTAT_MAX];
+
+void
+lockstat_print(int sortby)
+{
+	static const char *const kindnames[] = { "lock", "spin", "wchan" };
+	struct lockstat *snap = lockstat_snap, tmp;
+	unsigned num, i, j;
+
+	/*
+	 * Take a snapshot so we don't hold the spinlock while sorting
+	 * and printing (kprintf can sleep).
+	 */
+	spinlock_acquire(&lockstat_lock);
+	num = numlockstats;
+	memcpy(snap, lockstats, num * sizeof(*snap));
+	spinlock_release(&lockstat_lock);
+
+	/* Insertion sort; there are at most LOCKSTAT_MAX entries. */
+	for (i=1; i<num; i++) {
+		tmp = snap[i];
+		for (j=i; j>0 && lockstat_before(&tmp, &snap[j-1], sortby);
+		     j--) {
+			snap[j] = snap[j-1];
+		}
+		snap[j] = tmp;
+	}
+
+	kprintf("%-24s %-5s %10s %10s %14s %12s\n", "name", "kind",
+		"acquires", "contended", "wait (usec)", "maxhold (usec)");
+	for (i=0; i<num; i++) {
+		if (snap[i].ls_acquires == 0) {
+			continue;
+		}
+		kprintf("%-24s %-5s %10u %10u %14llu %12llu\n",
+			snap[i].ls_name, kindnames[snap[i].ls_kind],
+			snap[i].ls_acquires, snap[i].ls_contended,
+			(unsigned long long)(snap[i].ls_waitnsec / 1000),
+			(unsigned long long)(snap[i].ls_maxholdnsec / 1000));
+	}
+}
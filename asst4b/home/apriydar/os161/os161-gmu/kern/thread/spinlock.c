@@ -38,6 +38,7 @@
 #include <spinlock.h>
 #include <membar.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -52,6 +53,10 @@ spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
+#if OPT_LOCKSTAT
+	splk->splk_stat = NULL;
+	splk->splk_acquired = 0;
+#endif
 }
 
 /*
@@ -75,6 +80,10 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+#if OPT_LOCKSTAT
+	bool contended = false;
+	uint64_t waitstart = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -102,6 +111,12 @@ spinlock_acquire(struct spinlock *splk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&splk->splk_lock) != 0) {
+#if OPT_LOCKSTAT
+			if (!contended && splk->splk_stat != NULL) {
+				contended = true;
+				waitstart = lockstat_now();
+			}
+#endif
 			continue;
 		}
 		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
@@ -112,6 +127,13 @@ spinlock_acquire(struct spinlock *splk)
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	if (splk->splk_stat != NULL) {
+		splk->splk_acquired = lockstat_acquired(splk->splk_stat,
+							contended, waitstart);
+	}
+#endif
 }
 
 /*
@@ -127,6 +149,12 @@ spinlock_release(struct spinlock *splk)
 		curcpu->c_spinlocks--;
 	}
 
+#if OPT_LOCKSTAT
+	if (splk->splk_stat != NULL) {
+		lockstat_released(splk->splk_stat, splk->splk_acquired);
+	}
+#endif
+
 	splk->splk_holder = NULL;
 	membar_any_store();
 	spinlock_data_set(&splk->splk_lock, 0);
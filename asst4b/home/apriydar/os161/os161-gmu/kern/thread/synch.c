@@ -34,11 +34,13 @@
 
 #include <types.h>
 #include <lib.h>
+#include <cpu.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -68,6 +70,9 @@ sem_create(const char *name, unsigned initial_count)
 	}
 
 	spinlock_init(&sem->sem_lock);
+#if OPT_LOCKSTAT
+	lockstat_spinlock_init(&sem->sem_lock, sem->sem_name);
+#endif
         sem->sem_count = initial_count;
 
         return sem;
@@ -139,6 +144,79 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Priority inheritance state (t_waitlock, t_heldlocks, lk_thread,
+ * lk_donated, lk_heldnext) is shared between locks, so it has one
+ * spinlock of its own. It nests inside lk_spinlock and outside the
+ * run queue locks.
+ */
+static struct spinlock lock_pi_spinlock = SPINLOCK_INITIALIZER;
+
+/*
+ * Donations are followed at most this far, which also keeps a
+ * deadlocked cycle of holders from looping forever.
+ */
+#define LOCK_PI_MAXDEPTH 16
+
+/*
+ * Give PRIORITY to the holder of LOCK, to whatever that thread is
+ * waiting for, and so on down the chain, stopping once a holder is
+ * already at least that urgent.
+ */
+static
+void
+lock_donate(struct lock *lock, int priority)
+{
+	struct thread *holder;
+	int depth;
+
+	KASSERT(spinlock_do_i_hold(&lock_pi_spinlock));
+
+	for (depth = 0; lock != NULL && depth < LOCK_PI_MAXDEPTH; depth++) {
+		if (lock->lk_donated < priority) {
+			lock->lk_donated = priority;
+		}
+		holder = (struct thread *)lock->lk_thread;
+		if (holder == NULL || holder->t_effpriority >= priority) {
+			break;
+		}
+		thread_set_effpriority(holder, priority);
+		lock = holder->t_waitlock;
+	}
+}
+
+/*
+ * Work out what T's effective priority should be from its base
+ * priority and the waiters on the locks it still holds.
+ */
+static
+void
+lock_recompute(struct thread *t)
+{
+	struct lock *held;
+	int priority;
+
+	KASSERT(spinlock_do_i_hold(&lock_pi_spinlock));
+
+	priority = t->t_priority;
+	for (held = t->t_heldlocks; held != NULL; held = held->lk_heldnext) {
+		if (held->lk_donated > priority) {
+			priority = held->lk_donated;
+		}
+	}
+	if (priority != t->t_effpriority) {
+		thread_set_effpriority(t, priority);
+	}
+}
+
+void
+lock_refresh_priority(struct thread *t)
+{
+	spinlock_acquire(&lock_pi_spinlock);
+	lock_recompute(t);
+	spinlock_release(&lock_pi_spinlock);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -168,6 +246,13 @@ lock_create(const char *name)
 	spinlock_init(&lock->lk_spinlock);
 	lock->lk_locked = false;
 	lock->lk_thread = NULL;	
+	lock->lk_donated = -1;
+	lock->lk_heldnext = NULL;
+#if OPT_LOCKSTAT
+	lockstat_spinlock_init(&lock->lk_spinlock, lock->lk_name);
+	lock->lk_stat = lockstat_get(lock->lk_name, LOCKSTAT_LOCK);
+	lock->lk_acquired = 0;
+#endif
         return lock;
 }
 
@@ -190,6 +275,11 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {		
+#if OPT_LOCKSTAT
+	bool contended = false;
+	uint64_t waitstart = 0;
+#endif
+
 	KASSERT(lock != NULL);
         KASSERT(curthread->t_in_interrupt == false);
 	//kprintf("\nLock acquire\n");
@@ -199,14 +289,39 @@ lock_acquire(struct lock *lock)
 	
 	while (lock->lk_locked == true) {
 		//sleep while locked
+#if OPT_LOCKSTAT
+		if (!contended) {
+			contended = true;
+			waitstart = lockstat_now();
+		}
+#endif
+		spinlock_acquire(&lock_pi_spinlock);
+		curthread->t_waitlock = lock;
+		lock_donate(lock, curthread->t_effpriority);
+		spinlock_release(&lock_pi_spinlock);
 	
  		wchan_sleep(lock->lk_wchan, &lock->lk_spinlock);
 		
         }
         KASSERT(lock->lk_locked == false); // checking if unlocked
 	//assign current thread to lock and lock it
+	spinlock_acquire(&lock_pi_spinlock);
+	curthread->t_waitlock = NULL;
         lock->lk_thread=curthread;
+	lock->lk_heldnext = curthread->t_heldlocks;
+	curthread->t_heldlocks = lock;
+	/* whoever is still waiting now donates to us */
+	lock->lk_donated = wchan_maxpriority(lock->lk_wchan,
+					     &lock->lk_spinlock);
+	if (lock->lk_donated > curthread->t_effpriority) {
+		thread_set_effpriority(curthread, lock->lk_donated);
+	}
+	spinlock_release(&lock_pi_spinlock);
 	lock->lk_locked = true;
+#if OPT_LOCKSTAT
+	lock->lk_acquired = lockstat_acquired(lock->lk_stat, contended,
+					      waitstart);
+#endif
 
 	spinlock_release(&lock->lk_spinlock);
 	//kprintf("Lock acquire end");
@@ -215,6 +330,9 @@ lock_acquire(struct lock *lock)
 void
 lock_release(struct lock *lock)
 {
+	struct lock **pp;
+	int oldpriority;
+
         // Write this
         //kprintf("Lock release");
 	KASSERT(lock != NULL); // if lock has something
@@ -222,11 +340,35 @@ lock_release(struct lock *lock)
 	if(lock_do_i_hold(lock) ) //current thread should hold lock in order to release it
 	{
 		spinlock_acquire(&lock->lk_spinlock);
+#if OPT_LOCKSTAT
+		lockstat_released(lock->lk_stat, lock->lk_acquired);
+#endif
+		spinlock_acquire(&lock_pi_spinlock);
+		for (pp = &curthread->t_heldlocks; *pp != lock;
+		     pp = &(*pp)->lk_heldnext) {
+			KASSERT(*pp != NULL);
+		}
+		*pp = lock->lk_heldnext;
+		lock->lk_heldnext = NULL;
         	lock->lk_thread=NULL;
+		/* give back whatever this lock's waiters lent us */
+		oldpriority = curthread->t_effpriority;
+		lock_recompute(curthread);
+		spinlock_release(&lock_pi_spinlock);
 		lock->lk_locked = false;
 		KASSERT(lock->lk_locked == false);
 	        wchan_wakeone(lock->lk_wchan, &lock->lk_spinlock);//only waking this lock
 		spinlock_release(&lock->lk_spinlock);
+
+		/*
+		 * If we were running on borrowed priority, the thread
+		 * that lent it is now runnable and should get the cpu
+		 * right away rather than at the next timer tick.
+		 */
+		if (curthread->t_effpriority < oldpriority &&
+		    curcpu->c_spinlocks == 0) {
+			thread_yield();
+		}
 	}
 	//kprintf("Lock release end");
 	
@@ -345,3 +487,217 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 
 
 
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rw;
+
+        rw = kmalloc(sizeof(struct rwlock));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rwlock_name = kstrdup(name);
+        if (rw->rwlock_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+	rw->rw_readwchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+	rw->rw_writewchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+	rw->rw_upgradewchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_upgradewchan == NULL) {
+		wchan_destroy(rw->rw_writewchan);
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rwlock_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_spinlock);
+#if OPT_LOCKSTAT
+	lockstat_spinlock_init(&rw->rw_spinlock, rw->rwlock_name);
+#endif
+	rw->rw_readers = 0;
+	rw->rw_writers_waiting = 0;
+	rw->rw_writer = NULL;
+	rw->rw_upgrading = false;
+
+        return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_writers_waiting == 0);
+
+	/* wchan_destroy will assert if anyone's waiting on them */
+	spinlock_cleanup(&rw->rw_spinlock);
+	wchan_destroy(rw->rw_upgradewchan);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+
+        kfree(rw->rwlock_name);
+        kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(rw->rw_writer != curthread);
+
+	spinlock_acquire(&rw->rw_spinlock);
+
+	/* writers (and a pending upgrade) go first */
+	while (rw->rw_writer != NULL || rw->rw_writers_waiting > 0 ||
+	       rw->rw_upgrading) {
+		wchan_sleep(rw->rw_readwchan, &rw->rw_spinlock);
+	}
+	rw->rw_readers++;
+
+	spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_spinlock);
+
+	KASSERT(rw->rw_readers > 0);
+	rw->rw_readers--;
+
+	if (rw->rw_upgrading && rw->rw_readers == 1) {
+		/* only the upgrader is left; let it through */
+		wchan_wakeone(rw->rw_upgradewchan, &rw->rw_spinlock);
+	}
+	else if (rw->rw_readers == 0 && rw->rw_writers_waiting > 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_spinlock);
+	}
+
+	spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(rw->rw_writer != curthread);
+
+	spinlock_acquire(&rw->rw_spinlock);
+
+	rw->rw_writers_waiting++;
+	while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+		wchan_sleep(rw->rw_writewchan, &rw->rw_spinlock);
+	}
+	rw->rw_writers_waiting--;
+	rw->rw_writer = curthread;
+
+	spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_spinlock);
+
+	rw->rw_writer = NULL;
+	if (rw->rw_writers_waiting > 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_spinlock);
+	}
+	else {
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_spinlock);
+	}
+
+	spinlock_release(&rw->rw_spinlock);
+}
+
+bool
+rwlock_upgrade(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_spinlock);
+
+	KASSERT(rw->rw_readers > 0);
+
+	if (rw->rw_upgrading) {
+		/*
+		 * Two readers can't both upgrade atomically; each
+		 * would wait forever for the other to leave. Give up
+		 * our read hold and queue up as an ordinary writer.
+		 */
+		spinlock_release(&rw->rw_spinlock);
+		rwlock_release_read(rw);
+		rwlock_acquire_write(rw);
+		return false;
+	}
+
+	/*
+	 * Block new readers and writers and wait for the other
+	 * readers to drain. A waiting upgrader beats waiting writers,
+	 * since it already holds part of the lock.
+	 */
+	rw->rw_upgrading = true;
+	while (rw->rw_readers > 1) {
+		wchan_sleep(rw->rw_upgradewchan, &rw->rw_spinlock);
+	}
+	rw->rw_upgrading = false;
+	rw->rw_readers = 0;
+	rw->rw_writer = curthread;
+
+	spinlock_release(&rw->rw_spinlock);
+	return true;
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rwlock_do_i_hold_write(rw));
+
+	spinlock_acquire(&rw->rw_spinlock);
+
+	rw->rw_writer = NULL;
+	rw->rw_readers = 1;
+
+	/* other readers can come in too, unless a writer is queued */
+	if (rw->rw_writers_waiting == 0) {
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_spinlock);
+	}
+
+	spinlock_release(&rw->rw_spinlock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	return (rw->rw_writer == curthread);
+}
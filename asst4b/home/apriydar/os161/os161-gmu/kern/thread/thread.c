@@ -50,6 +50,7 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <lockstat.h>
 
 #include "opt-synchprobs.h"
 
@@ -57,11 +58,17 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/* Most exited threads (with their stacks) each cpu keeps for reuse. */
+#define THREAD_CACHE_MAX 16
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
 	struct threadlist wc_threads;	/* list of waiting threads */
 	unsigned wc_index;		/* index into allwchans[] */
+#if OPT_LOCKSTAT
+	struct lockstat *wc_stat;	/* sleep statistics */
+#endif
 };
 
 /* Master array of CPUs. */
@@ -117,6 +124,8 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+static void thread_initfields(struct thread *thread);
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -139,25 +148,50 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
+	thread->t_stack = NULL;
+	thread_initfields(thread);
+
+	return thread;
+}
+
+/*
+ * Set up everything in a thread except its name and stack. Shared by
+ * thread_create and threads coming back out of the per-cpu cache.
+ */
+static
+void
+thread_initfields(struct thread *thread)
+{
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
 
+	/* Scheduling priority fields */
+	thread->t_priority = PRI_DEFAULT;
+	thread->t_effpriority = PRI_DEFAULT;
+	thread->t_waitlock = NULL;
+	thread->t_heldlocks = NULL;
+
+	/* CPU accounting fields */
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+	thread->t_intrfromuser = false;
+
+	/* Interruptible sleep fields */
+	thread->t_intrwchan = NULL;
+	thread->t_intrlock = NULL;
+
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
 	/* If you add to struct thread, be sure to initialize here */
-
-	return thread;
 }
 
 /*
@@ -185,12 +219,16 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+#if OPT_LOCKSTAT
+	lockstat_spinlock_init(&c->c_runqueue_lock, "runqueue");
+#endif
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -234,6 +272,15 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+/*
+ * Return the number of cpus we know about.
+ */
+unsigned
+cpu_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * Destroy a thread.
  *
@@ -269,9 +316,78 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Put an exited thread in this cpu's cache instead of destroying it,
+ * keeping its struct and stack around for the next thread_fork.
+ * Threads without their own stack (boot threads) and threads beyond
+ * the cache limit are destroyed as usual.
+ *
+ * The cache is per-cpu and only touched by its own cpu with
+ * interrupts off, so it needs no lock.
+ */
+static
+void
+thread_cache_put(struct thread *thread)
+{
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(thread->t_proc == NULL);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadcache.tl_count >= THREAD_CACHE_MAX) {
+		thread_destroy(thread);
+		return;
+	}
+
+	/* Don't hand a trashed stack to somebody else. */
+	thread_checkstack(thread);
+
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_machdep_cleanup(&thread->t_machdep);
+	kfree(thread->t_name);
+	thread->t_name = NULL;
+	thread->t_wchan_name = "CACHED";
+
+	threadlistnode_init(&thread->t_listnode, thread);
+	threadlist_addhead(&curcpu->c_threadcache, thread);
+}
+
+/*
+ * Take a thread, stack and all, from this cpu's cache and set it up
+ * as a fresh thread named NAME. Returns NULL if the cache is empty.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	char *namecopy;
+	int spl;
+
+	namecopy = kstrdup(name);
+	if (namecopy == NULL) {
+		return NULL;
+	}
+
+	/* Interrupts off, so we can't migrate away from curcpu. */
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+
+	if (thread == NULL) {
+		kfree(namecopy);
+		return NULL;
+	}
+
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread->t_name = namecopy;
+	thread_initfields(thread);
+	return thread;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Most of them go into
+ * the thread cache for reuse rather than being destroyed outright.
  *
  * The list of zombies is per-cpu.
  */
@@ -284,7 +400,7 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		thread_cache_put(z);
 	}
 }
 
@@ -442,6 +558,27 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Put a thread on a run queue behind every thread of the same or
+ * higher effective priority, so the head of the queue is always the
+ * most urgent thread and equal priorities are served round-robin.
+ * The run queue's lock must be held.
+ */
+static
+void
+runqueue_insert(struct threadlist *rq, struct thread *t)
+{
+	struct thread *prev;
+
+	THREADLIST_FORALL_REV(prev, *rq) {
+		if (prev->t_effpriority >= t->t_effpriority) {
+			threadlist_insertafter(rq, prev, t);
+			return;
+		}
+	}
+	threadlist_addhead(rq, t);
+}
+
 /*
  * Make a thread runnable.
  *
@@ -466,7 +603,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	runqueue_insert(&targetcpu->c_runqueue, target);
 
 	if (targetcpu->c_isidle) {
 		/*
@@ -510,16 +647,20 @@ thread_fork(const char *name,
 	    DEBUG(DB_THREADS,"Forking thread: %s\n",name);
     }
 
-	newthread = thread_create(name);
+	/* Reuse an exited thread and its stack if this cpu has one */
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
 	}
 	thread_checkstack_init(newthread);
 
@@ -529,6 +670,8 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_priority = curthread->t_priority;
+	newthread->t_effpriority = curthread->t_priority;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -597,13 +740,30 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. Yielding
+	 * to a thread of lower priority counts as nothing to do.
+	 */
+	if (newstate == S_READY &&
+	    (threadlist_isempty(&curcpu->c_runqueue) ||
+	     curcpu->c_runqueue.tl_head.tln_next->tln_self->t_effpriority
+	     < cur->t_effpriority)) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
 	}
 
+	/*
+	 * Count the switch. Yielding from an interrupt handler means
+	 * the timer preempted us; anything else is our own doing.
+	 */
+	if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_usage.cu_nivcsw++;
+	}
+	else if (newstate != S_ZOMBIE) {
+		cur->t_usage.cu_nvcsw++;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -821,6 +981,19 @@ thread_exit(void)
 	panic("braaaaaaaiiiiiiiiiiinssssss\n");
 }
 
+/*
+ * Add up CPU usage counts.
+ */
+void
+cpuusage_add(struct cpuusage *sum, const struct cpuusage *cu)
+{
+	sum->cu_utime += cu->cu_utime;
+	sum->cu_stime += cu->cu_stime;
+	sum->cu_nvcsw += cu->cu_nvcsw;
+	sum->cu_nivcsw += cu->cu_nivcsw;
+	sum->cu_nfaults += cu->cu_nfaults;
+}
+
 /*
  * Yield the cpu to another process, but stay runnable.
  */
@@ -830,6 +1003,69 @@ thread_yield(void)
 	thread_switch(S_READY, NULL, NULL);
 }
 
+/*
+ * Set the base priority of the current thread. Priority it has
+ * inherited through locks it holds is kept.
+ */
+void
+thread_setpriority(int priority)
+{
+	if (priority < PRI_MIN) {
+		priority = PRI_MIN;
+	}
+	if (priority > PRI_MAX) {
+		priority = PRI_MAX;
+	}
+	curthread->t_priority = priority;
+	lock_refresh_priority(curthread);
+}
+
+/*
+ * Set the effective priority of T. If it is waiting on a run queue,
+ * take it off and put it back so the queue stays in order.
+ *
+ * t_cpu can change under us (thread_consider_migration) so check it
+ * again once we have the run queue lock. While the thread is being
+ * migrated it has no cpu and isn't on any run queue; it gets put in
+ * order when it lands.
+ */
+void
+thread_set_effpriority(struct thread *t, int priority)
+{
+	struct cpu *c;
+	struct thread *rt;
+
+	while (1) {
+		c = t->t_cpu;
+		if (c == NULL) {
+			t->t_effpriority = priority;
+			return;
+		}
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (t->t_cpu == c) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	t->t_effpriority = priority;
+	if (t->t_state == S_READY) {
+		/*
+		 * Look for it rather than trusting t_state: for a moment
+		 * a thread can be S_READY and off its queue (see
+		 * thread_consider_migration).
+		 */
+		THREADLIST_FORALL(rt, c->c_runqueue) {
+			if (rt == t) {
+				threadlist_remove(&c->c_runqueue, t);
+				runqueue_insert(&c->c_runqueue, t);
+				break;
+			}
+		}
+	}
+	spinlock_release(&c->c_runqueue_lock);
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -895,7 +1131,16 @@ thread_consider_migration(void)
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 	for (i=0; i<to_send; i++) {
+		/*
+		 * Take from the tail, so the least urgent threads are
+		 * the ones that move. While a thread sits on the victims
+		 * list it is on no run queue; clear t_cpu so
+		 * thread_set_effpriority doesn't go looking for it.
+		 */
 		t = threadlist_remtail(&curcpu->c_runqueue);
+		if (t != curthread) {
+			t->t_cpu = NULL;
+		}
 		threadlist_addhead(&victims, t);
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
@@ -937,7 +1182,7 @@ thread_consider_migration(void)
 			}
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			runqueue_insert(&c->c_runqueue, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -961,7 +1206,8 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			t->t_cpu = curcpu->c_self;
+			runqueue_insert(&curcpu->c_runqueue, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -996,6 +1242,9 @@ wchan_create(const char *name)
 	}
 	threadlist_init(&wc->wc_threads);
 	wc->wc_name = name;
+#if OPT_LOCKSTAT
+	wc->wc_stat = lockstat_get(name, LOCKSTAT_WCHAN);
+#endif
 
 	/* add to allwchans[] */
 	spinlock_acquire(&allwchans_lock);
@@ -1048,6 +1297,10 @@ wchan_destroy(struct wchan *wc)
 void
 wchan_sleep(struct wchan *wc, struct spinlock *lk)
 {
+#if OPT_LOCKSTAT
+	uint64_t sleepstart;
+#endif
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
@@ -1057,27 +1310,47 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	/* must not hold other spinlocks */
 	KASSERT(curcpu->c_spinlocks == 1);
 
+#if OPT_LOCKSTAT
+	sleepstart = lockstat_now();
+#endif
+
 	thread_switch(S_SLEEP, wc, lk);
 	spinlock_acquire(lk);
+
+#if OPT_LOCKSTAT
+	/* every sleep counts as contended; the "hold" is the sleep itself */
+	lockstat_acquired(wc->wc_stat, true, sleepstart);
+	lockstat_released(wc->wc_stat, sleepstart);
+#endif
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * Wake up one thread sleeping on a wait channel: the one with the
+ * highest effective priority, or the longest sleeper among those.
+ * Sleepers can be boosted while on the list by priority inheritance,
+ * so the list isn't kept sorted; look through it instead.
  */
 void
 wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 {
-	struct thread *target;
+	struct thread *target, *t;
 
 	KASSERT(spinlock_do_i_hold(lk));
 
 	/* Grab a thread from the channel */
-	target = threadlist_remhead(&wc->wc_threads);
+	target = NULL;
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (target == NULL ||
+		    t->t_effpriority > target->t_effpriority) {
+			target = t;
+		}
+	}
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
 		return;
 	}
+	threadlist_remove(&wc->wc_threads, target);
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1090,6 +1363,25 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	thread_make_runnable(target, false);
 }
 
+/*
+ * Return the highest effective priority among the sleepers, or -1.
+ */
+int
+wchan_maxpriority(struct wchan *wc, struct spinlock *lk)
+{
+	struct thread *t;
+	int max = -1;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (t->t_effpriority > max) {
+			max = t->t_effpriority;
+		}
+	}
+	return max;
+}
+
 /*
  * Wake up all threads sleeping on a wait channel.
  */
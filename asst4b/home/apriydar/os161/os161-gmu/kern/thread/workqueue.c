@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel workqueues: deferred work run by per-cpu worker threads.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <workqueue.h>
+
+/* Worker threads started for each cpu. */
+#define WORKERS_PER_CPU 2
+
+/*
+ * A queue. The counts are protected by wq_lock, which nests inside
+ * the pool locks.
+ */
+struct workqueue {
+	char *wq_name;
+	struct spinlock wq_lock;
+	struct wchan *wq_flushwchan;	/* work_flush callers */
+	unsigned wq_maxactive;		/* concurrency limit */
+	unsigned wq_active;		/* items running right now */
+	unsigned wq_outstanding;	/* items queued or running */
+	bool wq_throttled;		/* a worker skipped us at the limit */
+};
+
+/*
+ * One item of pending work.
+ */
+struct work {
+	struct work *w_next;
+	struct workqueue *w_wq;
+	void (*w_func)(void *data1, unsigned long data2);
+	void *w_data1;
+	unsigned long w_data2;
+};
+
+/*
+ * Per-cpu pool of workers and the work handed to it, in FIFO order.
+ */
+struct workpool {
+	struct spinlock wp_lock;
+	struct wchan *wp_wchan;		/* idle workers */
+	struct work *wp_head;
+	struct work *wp_tail;
+	unsigned wp_idle;		/* # of workers asleep */
+};
+
+static struct workpool *workpools;
+static unsigned nworkpools;
+
+/*
+ * Take the first item off POOL whose queue is below its concurrency
+ * limit, and count it as active. Returns NULL if there is none.
+ */
+static
+struct work *
+workpool_take(struct workpool *pool)
+{
+	struct work *w, **wp, *prev;
+	struct workqueue *wq;
+
+	KASSERT(spinlock_do_i_hold(&pool->wp_lock));
+
+	prev = NULL;
+	for (wp = &pool->wp_head; *wp != NULL; wp = &(*wp)->w_next) {
+		w = *wp;
+		wq = w->w_wq;
+
+		spinlock_acquire(&wq->wq_lock);
+		if (wq->wq_active >= wq->wq_maxactive) {
+			wq->wq_throttled = true;
+			spinlock_release(&wq->wq_lock);
+			prev = w;
+			continue;
+		}
+		wq->wq_active++;
+		spinlock_release(&wq->wq_lock);
+
+		*wp = w->w_next;
+		if (pool->wp_tail == w) {
+			pool->wp_tail = prev;
+		}
+		w->w_next = NULL;
+		return w;
+	}
+	return NULL;
+}
+
+/*
+ * Wake one idle worker in every pool. Used when a throttled queue
+ * drops below its limit, since its waiting items may be anywhere.
+ */
+static
+void
+workpool_kickall(void)
+{
+	struct workpool *pool;
+	unsigned i;
+
+	for (i=0; i<nworkpools; i++) {
+		pool = &workpools[i];
+		spinlock_acquire(&pool->wp_lock);
+		if (pool->wp_idle > 0) {
+			wchan_wakeone(pool->wp_wchan, &pool->wp_lock);
+		}
+		spinlock_release(&pool->wp_lock);
+	}
+}
+
+/*
+ * Worker thread. Runs work from its pool forever.
+ */
+static
+void
+workpool_worker(void *p, unsigned long unused)
+{
+	struct workpool *pool = p;
+	struct workqueue *wq;
+	struct work *w;
+	bool kick;
+
+	(void)unused;
+
+	while (1) {
+		spinlock_acquire(&pool->wp_lock);
+		while ((w = workpool_take(pool)) == NULL) {
+			pool->wp_idle++;
+			wchan_sleep(pool->wp_wchan, &pool->wp_lock);
+			pool->wp_idle--;
+		}
+		spinlock_release(&pool->wp_lock);
+
+		wq = w->w_wq;
+		w->w_func(w->w_data1, w->w_data2);
+		kfree(w);
+
+		spinlock_acquire(&wq->wq_lock);
+		KASSERT(wq->wq_active > 0);
+		KASSERT(wq->wq_outstanding > 0);
+		wq->wq_active--;
+		wq->wq_outstanding--;
+		kick = wq->wq_throttled;
+		wq->wq_throttled = false;
+		if (wq->wq_outstanding == 0) {
+			wchan_wakeall(wq->wq_flushwchan, &wq->wq_lock);
+		}
+		spinlock_release(&wq->wq_lock);
+
+		if (kick) {
+			workpool_kickall();
+		}
+	}
+}
+
+/*
+ * Set up a pool for each cpu and start its workers.
+ */
+void
+workqueue_bootstrap(void)
+{
+	struct workpool *pools;
+	char name[16];
+	unsigned i, j, n;
+	int result;
+
+	n = cpu_numcpus();
+	pools = kmalloc(n * sizeof(*pools));
+	if (pools == NULL) {
+		panic("workqueue_bootstrap: Out of memory\n");
+	}
+
+	for (i=0; i<n; i++) {
+		spinlock_init(&pools[i].wp_lock);
+		pools[i].wp_wchan = wchan_create("workpool");
+		if (pools[i].wp_wchan == NULL) {
+			panic("workqueue_bootstrap: wchan_create failed\n");
+		}
+		pools[i].wp_head = pools[i].wp_tail = NULL;
+		pools[i].wp_idle = 0;
+	}
+
+	/* Publish the pools before any worker can look at them. */
+	workpools = pools;
+	nworkpools = n;
+
+	for (i=0; i<n; i++) {
+		for (j=0; j<WORKERS_PER_CPU; j++) {
+			snprintf(name, sizeof(name), "worker%u.%u", i, j);
+			result = thread_fork(name, NULL, workpool_worker,
+					     &pools[i], 0);
+			if (result) {
+				panic("workqueue_bootstrap: thread_fork: %s\n",
+				      strerror(result));
+			}
+		}
+	}
+}
+
+struct workqueue *
+workqueue_create(const char *name, unsigned maxactive)
+{
+	struct workqueue *wq;
+
+	KASSERT(maxactive > 0);
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return NULL;
+	}
+
+	wq->wq_name = kstrdup(name);
+	if (wq->wq_name == NULL) {
+		kfree(wq);
+		return NULL;
+	}
+
+	wq->wq_flushwchan = wchan_create(wq->wq_name);
+	if (wq->wq_flushwchan == NULL) {
+		kfree(wq->wq_name);
+		kfree(wq);
+		return NULL;
+	}
+
+	spinlock_init(&wq->wq_lock);
+	wq->wq_maxactive = maxactive;
+	wq->wq_active = 0;
+	wq->wq_outstanding = 0;
+	wq->wq_throttled = false;
+	return wq;
+}
+
+void
+workqueue_destroy(struct workqueue *wq)
+{
+	KASSERT(wq != NULL);
+	KASSERT(wq->wq_outstanding == 0);
+
+	spinlock_cleanup(&wq->wq_lock);
+	wchan_destroy(wq->wq_flushwchan);
+	kfree(wq->wq_name);
+	kfree(wq);
+}
+
+int
+work_enqueue(struct workqueue *wq,
+	     void (*func)(void *data1, unsigned long data2),
+	     void *data1, unsigned long data2)
+{
+	struct workpool *pool;
+	struct work *w;
+
+	KASSERT(wq != NULL);
+	KASSERT(func != NULL);
+
+	if (workpools == NULL) {
+		return EAGAIN;
+	}
+
+	w = kmalloc(sizeof(*w));
+	if (w == NULL) {
+		return ENOMEM;
+	}
+	w->w_next = NULL;
+	w->w_wq = wq;
+	w->w_func = func;
+	w->w_data1 = data1;
+	w->w_data2 = data2;
+
+	spinlock_acquire(&wq->wq_lock);
+	wq->wq_outstanding++;
+	spinlock_release(&wq->wq_lock);
+
+	/*
+	 * Use this cpu's pool. If we migrate right after reading
+	 * curcpu it's only a missed chance at locality, not a bug.
+	 */
+	pool = &workpools[curcpu->c_number];
+
+	spinlock_acquire(&pool->wp_lock);
+	if (pool->wp_tail == NULL) {
+		pool->wp_head = w;
+	}
+	else {
+		pool->wp_tail->w_next = w;
+	}
+	pool->wp_tail = w;
+	if (pool->wp_idle > 0) {
+		wchan_wakeone(pool->wp_wchan, &pool->wp_lock);
+	}
+	spinlock_release(&pool->wp_lock);
+
+	return 0;
+}
+
+void
+work_flush(struct workqueue *wq)
+{
+	KASSERT(wq != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&wq->wq_lock);
+	while (wq->wq_outstanding > 0) {
+		wchan_sleep(wq->wq_flushwchan, &wq->wq_lock);
+	}
+	spinlock_release(&wq->wq_lock);
+}
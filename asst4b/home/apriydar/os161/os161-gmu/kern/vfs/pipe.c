@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipes.
+ *
+ * The ring buffer is indexed by free-running positions: pp_rpos is
+ * how many bytes have ever been read, pp_wpos how many have ever been
+ * written, so the pipe holds pp_wpos - pp_rpos bytes and has room for
+ * PIPE_SIZE minus that. Only a reader moves pp_rpos and only a writer
+ * moves pp_wpos, and pp_readlock and pp_writelock let just one of
+ * each in at a time. So once a reader has seen how much data there
+ * is, or a writer how much room, nobody else can touch that part of
+ * the buffer, and the copy to or from the user is done without
+ * holding pp_lock. The spinlock is only held to look at and move the
+ * positions and to sleep.
+ *
+ * Waiting for data or room is done before taking pp_readlock or
+ * pp_writelock, not while holding it, so that a reader asleep on an
+ * empty pipe doesn't also hold up an O_NONBLOCK reader that would
+ * rather get EAGAIN. Whoever then gets the lock checks again.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <proc.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+struct pipe {
+	struct spinlock pp_lock;	/* for the fields up to pp_buf */
+	struct wchan *pp_readwchan;	/* readers wait here for data */
+	struct wchan *pp_writewchan;	/* writers wait here for room */
+	unsigned pp_rpos;		/* total bytes read */
+	unsigned pp_wpos;		/* total bytes written */
+	bool pp_readeropen;		/* read end not yet reclaimed */
+	bool pp_writeropen;		/* write end not yet reclaimed */
+	struct pollqueue pp_pollq;	/* woken along with either wchan */
+
+	char *pp_buf;			/* PIPE_SIZE bytes, via kbuf_alloc */
+	struct lock *pp_readlock;	/* one reader at a time */
+	struct lock *pp_writelock;	/* one writer at a time */
+
+	struct vnode pp_readvn;		/* the two ends */
+	struct vnode pp_writevn;
+};
+
+/*
+ * Free a pipe. Both ends must be gone, or never have been set up.
+ */
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	if (pp->pp_readvn.vn_ops != NULL) {
+		vnode_cleanup(&pp->pp_readvn);
+	}
+	if (pp->pp_writevn.vn_ops != NULL) {
+		vnode_cleanup(&pp->pp_writevn);
+	}
+	if (pp->pp_writelock != NULL) {
+		lock_destroy(pp->pp_writelock);
+	}
+	if (pp->pp_readlock != NULL) {
+		lock_destroy(pp->pp_readlock);
+	}
+	kbuf_free(pp->pp_buf, PIPE_SIZE);
+	if (pp->pp_writewchan != NULL) {
+		wchan_destroy(pp->pp_writewchan);
+	}
+	if (pp->pp_readwchan != NULL) {
+		wchan_destroy(pp->pp_readwchan);
+	}
+	pollqueue_cleanup(&pp->pp_pollq);
+	spinlock_cleanup(&pp->pp_lock);
+	kfree(pp);
+}
+
+/*
+ * Move LEN bytes between the uio and the ring, starting at ring
+ * position POS. Takes two uiomoves if it wraps around the end.
+ * Returns how much was moved in *MOVED, even on error.
+ */
+static
+int
+pipe_uiomove(struct pipe *pp, unsigned pos, size_t len, struct uio *uio,
+	     size_t *moved)
+{
+	size_t off, first, resid;
+	int result;
+
+	resid = uio->uio_resid;
+	off = pos & (PIPE_SIZE - 1);
+	first = len < PIPE_SIZE - off ? len : PIPE_SIZE - off;
+	result = uiomove(pp->pp_buf + off, first, uio);
+	if (result == 0 && len > first) {
+		result = uiomove(pp->pp_buf, len - first, uio);
+	}
+	*moved = resid - uio->uio_resid;
+	return result;
+}
+
+/*
+ * Called when the last reference to one end goes away. Wakes up
+ * anyone waiting on the other end, so they see end of file or EPIPE,
+ * and frees the pipe once both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *pp = vn->vn_data;
+	bool gone;
+
+	/* we can't be looked up, but follow the protocol anyway */
+	spinlock_acquire(&vn->vn_countlock);
+	if (vn->vn_refcount > 1) {
+		vn->vn_refcount--;
+		spinlock_release(&vn->vn_countlock);
+		return EBUSY;
+	}
+	spinlock_release(&vn->vn_countlock);
+
+	spinlock_acquire(&pp->pp_lock);
+	if (vn == &pp->pp_readvn) {
+		pp->pp_readeropen = false;
+		wchan_wakeall(pp->pp_writewchan, &pp->pp_lock);
+	}
+	else {
+		pp->pp_writeropen = false;
+		wchan_wakeall(pp->pp_readwchan, &pp->pp_lock);
+	}
+	/*
+	 * Wake pollers before letting go of pp_lock: once it's
+	 * released the other end's reclaim can see both ends gone and
+	 * free the pipe.
+	 */
+	pollqueue_wakeup(&pp->pp_pollq);
+	gone = !pp->pp_readeropen && !pp->pp_writeropen;
+	spinlock_release(&pp->pp_lock);
+
+	if (gone) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Read: wait for some data (or for the writers to be gone), then take
+ * as much as there is, up to what was asked for. With O_NONBLOCK an
+ * empty pipe gives EAGAIN instead, and if the process is exiting
+ * the wait ends with EINTR.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	unsigned pos;
+	size_t len, moved;
+	bool sleeping = false;
+	int result;
+
+	if (vn != &pp->pp_readvn) {
+		return EBADF;
+	}
+
+	while (1) {
+		result = 0;
+		spinlock_acquire(&pp->pp_lock);
+		while (pp->pp_rpos == pp->pp_wpos && pp->pp_writeropen) {
+			result = uio->uio_nonblock ? EAGAIN :
+				proc_sleep(pp->pp_readwchan, &pp->pp_lock,
+					   &sleeping);
+			if (result) {
+				break;
+			}
+		}
+		spinlock_release(&pp->pp_lock);
+		if (sleeping) {
+			proc_sleepend();
+			sleeping = false;
+		}
+		if (result) {
+			return result;
+		}
+
+		lock_acquire(pp->pp_readlock);
+		spinlock_acquire(&pp->pp_lock);
+		if (pp->pp_rpos != pp->pp_wpos || !pp->pp_writeropen) {
+			break;
+		}
+		/* another reader got there first */
+		spinlock_release(&pp->pp_lock);
+		lock_release(pp->pp_readlock);
+	}
+	pos = pp->pp_rpos;
+	len = pp->pp_wpos - pos;
+	spinlock_release(&pp->pp_lock);
+
+	if (len > uio->uio_resid) {
+		len = uio->uio_resid;
+	}
+	result = pipe_uiomove(pp, pos, len, uio, &moved);
+
+	spinlock_acquire(&pp->pp_lock);
+	pp->pp_rpos += moved;
+	wchan_wakeall(pp->pp_writewchan, &pp->pp_lock);
+	spinlock_release(&pp->pp_lock);
+	pollqueue_wakeup(&pp->pp_pollq);
+
+	lock_release(pp->pp_readlock);
+	return result;
+}
+
+/*
+ * Write: put everything in, waiting for room as needed. A write of
+ * PIPE_BUF bytes or less waits until it fits in one go, so a reader
+ * never sees part of it. If the read end goes away we stop; that's
+ * EPIPE if nothing was written yet and a short write otherwise. With
+ * O_NONBLOCK we stop instead of waiting, the same way but with
+ * EAGAIN, and if the process is exiting, with EINTR.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	unsigned pos;
+	size_t room, need, len, moved, total;
+	bool sleeping = false;
+	int result;
+
+	if (vn != &pp->pp_writevn) {
+		return EBADF;
+	}
+
+	total = uio->uio_resid;
+	need = total <= PIPE_BUF ? total : 1;
+
+	while (uio->uio_resid > 0) {
+		result = 0;
+		spinlock_acquire(&pp->pp_lock);
+		while (pp->pp_readeropen &&
+		       PIPE_SIZE - (pp->pp_wpos - pp->pp_rpos) < need) {
+			result = uio->uio_nonblock ? EAGAIN :
+				proc_sleep(pp->pp_writewchan, &pp->pp_lock,
+					   &sleeping);
+			if (result) {
+				break;
+			}
+		}
+		if (result == 0 && !pp->pp_readeropen) {
+			result = EPIPE;
+		}
+		spinlock_release(&pp->pp_lock);
+		if (sleeping) {
+			proc_sleepend();
+			sleeping = false;
+		}
+		if (result) {
+			return uio->uio_resid == total ? result : 0;
+		}
+
+		lock_acquire(pp->pp_writelock);
+		spinlock_acquire(&pp->pp_lock);
+		room = PIPE_SIZE - (pp->pp_wpos - pp->pp_rpos);
+		if (room < need || !pp->pp_readeropen) {
+			/* another writer got there first; go around */
+			spinlock_release(&pp->pp_lock);
+			lock_release(pp->pp_writelock);
+			continue;
+		}
+		pos = pp->pp_wpos;
+		spinlock_release(&pp->pp_lock);
+
+		len = room < uio->uio_resid ? room : uio->uio_resid;
+		result = pipe_uiomove(pp, pos, len, uio, &moved);
+
+		spinlock_acquire(&pp->pp_lock);
+		pp->pp_wpos += moved;
+		wchan_wakeall(pp->pp_readwchan, &pp->pp_lock);
+		spinlock_release(&pp->pp_lock);
+		pollqueue_wakeup(&pp->pp_pollq);
+
+		lock_release(pp->pp_writelock);
+		if (result) {
+			return result;
+		}
+		need = 1;
+	}
+	return 0;
+}
+
+/*
+ * Pipes have no ioctls.
+ */
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+/*
+ * Poll: the read end is readable when there's data, and hung up when
+ * the writers are gone; the write end is writable when a PIPE_BUF
+ * write would go in without waiting, and in error when the readers
+ * are gone.
+ */
+static
+int
+pipe_poll(struct vnode *vn, struct poller *pl)
+{
+	struct pipe *pp = vn->vn_data;
+	int ready = 0;
+
+	poller_add(pl, &pp->pp_pollq);
+
+	spinlock_acquire(&pp->pp_lock);
+	if (vn == &pp->pp_readvn) {
+		if (pp->pp_rpos != pp->pp_wpos) {
+			ready |= POLLIN;
+		}
+		if (!pp->pp_writeropen) {
+			ready |= POLLHUP;
+		}
+	}
+	else {
+		if (PIPE_SIZE - (pp->pp_wpos - pp->pp_rpos) >= PIPE_BUF) {
+			ready |= POLLOUT;
+		}
+		if (!pp->pp_readeropen) {
+			ready |= POLLERR;
+		}
+	}
+	spinlock_release(&pp->pp_lock);
+
+	return ready;
+}
+
+/*
+ * Stat: a FIFO whose size is how much is waiting in it.
+ */
+static
+int
+pipe_stat(struct vnode *vn, struct stat *statbuf)
+{
+	struct pipe *pp = vn->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	spinlock_acquire(&pp->pp_lock);
+	statbuf->st_size = pp->pp_wpos - pp->pp_rpos;
+	spinlock_release(&pp->pp_lock);
+
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_BUF;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+/*
+ * Nothing to open, sync, or truncate.
+ */
+static
+int
+pipe_eachopen(struct vnode *vn, int flags)
+{
+	(void)vn;
+	(void)flags;
+	return EINVAL;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_nosys,
+	.vop_poll = pipe_poll,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+/*
+ * Make a pipe.
+ */
+int
+pipe_create(struct vnode **readvn_ret, struct vnode **writevn_ret)
+{
+	struct pipe *pp;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pp->pp_lock);
+	pollqueue_init(&pp->pp_pollq);
+	pp->pp_rpos = pp->pp_wpos = 0;
+	pp->pp_readeropen = pp->pp_writeropen = true;
+	pp->pp_readvn.vn_ops = NULL;
+	pp->pp_writevn.vn_ops = NULL;
+
+	pp->pp_readwchan = wchan_create("pipe read");
+	pp->pp_writewchan = wchan_create("pipe write");
+	pp->pp_buf = kbuf_alloc(PIPE_SIZE);
+	pp->pp_readlock = lock_create("pipe read");
+	pp->pp_writelock = lock_create("pipe write");
+	if (pp->pp_readwchan == NULL || pp->pp_writewchan == NULL ||
+	    pp->pp_buf == NULL ||
+	    pp->pp_readlock == NULL || pp->pp_writelock == NULL) {
+		pipe_destroy(pp);
+		return ENOMEM;
+	}
+
+	vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+
+	*readvn_ret = &pp->pp_readvn;
+	*writevn_ret = &pp->pp_writevn;
+	return 0;
+}
@@ -557,6 +557,9 @@ vfs_unmount(const char *devname)
 	struct knowndev *kd;
 	int result;
 
+	/* let pending reclaims drop their vnodes first */
+	vfs_reclaim_flush();
+
 	vfs_biglock_acquire();
 
 	result = findmount(devname, &kd);
@@ -604,6 +607,9 @@ vfs_unmountall(void)
 	unsigned i, num;
 	int result;
 
+	/* let pending reclaims drop their vnodes first */
+	vfs_reclaim_flush();
+
 	vfs_biglock_acquire();
 
 	num = knowndevarray_num(knowndevs);
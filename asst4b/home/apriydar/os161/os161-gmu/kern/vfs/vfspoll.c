@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll() support: pollqueues, pollers, and the wait loop.
+ *
+ * A poller is one call to vfs_poll. Each poller_add links a new
+ * pollentry onto both the pollqueue (so pollqueue_wakeup can find the
+ * poller) and the poller (so it can unlink everything when it's
+ * done). pollqueue_wakeup holds pq_lock while it touches the pollers,
+ * and poller_cleanup takes pq_lock to unlink, so a poller is never
+ * woken after it has gone. The lock order is pq_lock, then pl_lock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <proc.h>
+#include <vnode.h>
+#include <poll.h>
+
+struct poller {
+	struct spinlock pl_lock;	/* for pl_woken */
+	struct wchan *pl_wchan;		/* where vfs_poll sleeps */
+	bool pl_woken;			/* something happened */
+	bool pl_nomem;			/* a poller_add failed */
+	bool pl_sleeping;		/* set up by proc_sleep */
+	struct pollentry *pl_entries;	/* via pe_pollernext */
+};
+
+struct pollentry {
+	struct poller *pe_poller;
+	struct pollqueue *pe_queue;
+	struct pollentry *pe_next;	/* on pe_queue; under its pq_lock */
+	struct pollentry *pe_prev;
+	struct pollentry *pe_pollernext; /* on pe_poller; private to it */
+};
+
+/*
+ * Woken every tick by poll_tick, for pollers with a timeout.
+ */
+static struct pollqueue poll_tickq = { SPINLOCK_INITIALIZER, NULL };
+
+////////////////////////////////////////////////////////////
+// pollqueues
+
+void
+pollqueue_init(struct pollqueue *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_first = NULL;
+}
+
+void
+pollqueue_cleanup(struct pollqueue *pq)
+{
+	KASSERT(pq->pq_first == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+/*
+ * Wake up everyone polling on PQ. May be called from an interrupt
+ * handler.
+ */
+void
+pollqueue_wakeup(struct pollqueue *pq)
+{
+	struct pollentry *pe;
+	struct poller *pl;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_first; pe != NULL; pe = pe->pe_next) {
+		pl = pe->pe_poller;
+		spinlock_acquire(&pl->pl_lock);
+		pl->pl_woken = true;
+		wchan_wakeall(pl->pl_wchan, &pl->pl_lock);
+		spinlock_release(&pl->pl_lock);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+////////////////////////////////////////////////////////////
+// pollers
+
+static
+int
+poller_init(struct poller *pl)
+{
+	pl->pl_wchan = wchan_create("poll");
+	if (pl->pl_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pl->pl_lock);
+	pl->pl_woken = false;
+	pl->pl_nomem = false;
+	pl->pl_sleeping = false;
+	pl->pl_entries = NULL;
+	return 0;
+}
+
+/*
+ * Take the poller off all its queues.
+ */
+static
+void
+poller_cleanup(struct poller *pl)
+{
+	struct pollentry *pe;
+	struct pollqueue *pq;
+
+	while (pl->pl_entries != NULL) {
+		pe = pl->pl_entries;
+		pl->pl_entries = pe->pe_pollernext;
+
+		pq = pe->pe_queue;
+		spinlock_acquire(&pq->pq_lock);
+		if (pe->pe_prev != NULL) {
+			pe->pe_prev->pe_next = pe->pe_next;
+		}
+		else {
+			pq->pq_first = pe->pe_next;
+		}
+		if (pe->pe_next != NULL) {
+			pe->pe_next->pe_prev = pe->pe_prev;
+		}
+		spinlock_release(&pq->pq_lock);
+		kfree(pe);
+	}
+	if (pl->pl_sleeping) {
+		proc_sleepend();
+	}
+	wchan_destroy(pl->pl_wchan);
+	spinlock_cleanup(&pl->pl_lock);
+}
+
+/*
+ * Put PL on PQ. Does nothing if PL is NULL. If we run out of memory
+ * we note it, and vfs_poll fails once the object's state has been
+ * looked at.
+ */
+void
+poller_add(struct poller *pl, struct pollqueue *pq)
+{
+	struct pollentry *pe;
+
+	if (pl == NULL) {
+		return;
+	}
+	pe = kmalloc(sizeof(*pe));
+	if (pe == NULL) {
+		pl->pl_nomem = true;
+		return;
+	}
+	pe->pe_poller = pl;
+	pe->pe_queue = pq;
+	pe->pe_prev = NULL;
+	pe->pe_pollernext = pl->pl_entries;
+	pl->pl_entries = pe;
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_next = pq->pq_first;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_prev = pe;
+	}
+	pq->pq_first = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+/*
+ * Sleep until one of the poller's queues is woken. Anything that
+ * happened since the last wait counts. Gives up with EINTR if the
+ * process is exiting.
+ */
+static
+int
+poller_wait(struct poller *pl)
+{
+	int result = 0;
+
+	spinlock_acquire(&pl->pl_lock);
+	while (!pl->pl_woken && result == 0) {
+		result = proc_sleep(pl->pl_wchan, &pl->pl_lock,
+				    &pl->pl_sleeping);
+	}
+	pl->pl_woken = false;
+	spinlock_release(&pl->pl_lock);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// poll itself
+
+/*
+ * Check if the time DEADLINE has come.
+ */
+static
+bool
+poll_expired(const struct timespec *deadline)
+{
+	struct timespec now;
+
+	gettime(&now);
+	if (now.tv_sec != deadline->tv_sec) {
+		return now.tv_sec > deadline->tv_sec;
+	}
+	return now.tv_nsec >= deadline->tv_nsec;
+}
+
+int
+vfs_poll(struct vnode **vns, struct pollfd *fds, unsigned nfds,
+	 int timeout, unsigned *nready)
+{
+	struct poller pl, *plp;
+	struct timespec deadline, delay;
+	unsigned i, n;
+	int result;
+
+	result = poller_init(&pl);
+	if (result) {
+		return result;
+	}
+	if (timeout > 0) {
+		gettime(&deadline);
+		delay.tv_sec = timeout / 1000;
+		delay.tv_nsec = (timeout % 1000) * 1000000;
+		timespec_add(&deadline, &delay, &deadline);
+		poller_add(&pl, &poll_tickq);
+	}
+
+	/*
+	 * Get on everyone's queue the first time through; after that
+	 * we're already there and only need to look.
+	 */
+	plp = &pl;
+	while (1) {
+		n = 0;
+		for (i=0; i<nfds; i++) {
+			if (vns[i] != NULL) {
+				fds[i].revents = VOP_POLL(vns[i], plp) &
+					(fds[i].events | POLLERR | POLLHUP);
+			}
+			if (fds[i].revents != 0) {
+				n++;
+			}
+		}
+		plp = NULL;
+
+		if (pl.pl_nomem) {
+			result = ENOMEM;
+			break;
+		}
+		if (n > 0 || timeout == 0) {
+			break;
+		}
+		if (timeout > 0 && poll_expired(&deadline)) {
+			break;
+		}
+		result = poller_wait(&pl);
+		if (result) {
+			break;
+		}
+	}
+
+	poller_cleanup(&pl);
+	*nready = n;
+	return result;
+}
+
+/*
+ * Nudge pollers that are waiting for a timeout. Looking at pq_first
+ * without the lock is fine: at worst a new poller waits one more tick.
+ */
+void
+poll_tick(void)
+{
+	if (poll_tickq.pq_first != NULL) {
+		pollqueue_wakeup(&poll_tickq);
+	}
+}
@@ -32,10 +32,35 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <workqueue.h>
+
+/*
+ * Queue for deferred VOP_RECLAIM calls. Reclaims can write back an
+ * inode or truncate a removed file, which the thread doing the last
+ * close shouldn't have to wait for. One at a time is plenty, since
+ * they all serialize on the vfs big lock anyway.
+ */
+static struct workqueue *vnode_reclaimwq;
+
+/*
+ * Source of vn_version values.
+ */
+static struct spinlock vnode_versionlock = SPINLOCK_INITIALIZER;
+static uint32_t vnode_nextversion;
+
+static
+void
+vnode_newversion(struct vnode *vn)
+{
+	spinlock_acquire(&vnode_versionlock);
+	vn->vn_version = ++vnode_nextversion;
+	spinlock_release(&vnode_versionlock);
+}
 
 /*
  * Initialize an abstract vnode.
@@ -52,9 +77,35 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	spinlock_init(&vn->vn_countlock);
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
+	vnode_newversion(vn);
 	return 0;
 }
 
+/*
+ * Note that VN's contents may have changed. Done after the operation,
+ * even if it failed partway, so that anything read from the file
+ * while it was in progress is left under the old version.
+ */
+int
+vnode_changed(struct vnode *vn, int result)
+{
+	vnode_newversion(vn);
+	return result;
+}
+
+/*
+ * Poll. Objects without a vop_poll never block.
+ */
+int
+vnode_poll(struct vnode *vn, struct poller *pl)
+{
+	vnode_check(vn, "poll");
+	if (vn->vn_ops->vop_poll == NULL) {
+		return POLLIN | POLLOUT;
+	}
+	return vn->vn_ops->vop_poll(vn, pl);
+}
+
 /*
  * Destroy an abstract vnode.
  */
@@ -86,16 +137,65 @@ vnode_incref(struct vnode *vn)
 	spinlock_release(&vn->vn_countlock);
 }
 
+/*
+ * Call VOP_RECLAIM on a vnode whose last reference went away.
+ */
+static
+void
+vnode_reclaim(struct vnode *vn)
+{
+	int result;
+
+	result = VOP_RECLAIM(vn);
+	if (result != 0 && result != EBUSY) {
+		// XXX: lame.
+		kprintf("vfs: Warning: VOP_RECLAIM: %s\n",
+			strerror(result));
+	}
+}
+
+/*
+ * Workqueue entry point for deferred reclaims.
+ */
+static
+void
+vnode_reclaim_work(void *vn, unsigned long unused)
+{
+	(void)unused;
+	vnode_reclaim(vn);
+}
+
+void
+vfs_reclaim_bootstrap(void)
+{
+	vnode_reclaimwq = workqueue_create("vnode reclaim", 1);
+	if (vnode_reclaimwq == NULL) {
+		panic("vfs: Could not create reclaim workqueue\n");
+	}
+}
+
+void
+vfs_reclaim_flush(void)
+{
+	KASSERT(!vfs_biglock_do_i_hold());
+
+	if (vnode_reclaimwq != NULL) {
+		work_flush(vnode_reclaimwq);
+	}
+}
+
 /*
  * Decrement refcount.
  * Called by VOP_DECREF.
- * Calls VOP_RECLAIM if the refcount hits zero.
+ * Calls VOP_RECLAIM if the refcount hits zero, normally from a worker
+ * thread. The vnode keeps its last reference until then, so if it's
+ * looked up again in the meantime the reclaim sees the extra
+ * reference and backs off with EBUSY, as it would for any other race.
  */
 void
 vnode_decref(struct vnode *vn)
 {
 	bool destroy;
-	int result;
 
 	KASSERT(vn != NULL);
 
@@ -113,11 +213,11 @@ vnode_decref(struct vnode *vn)
 	spinlock_release(&vn->vn_countlock);
 
 	if (destroy) {
-		result = VOP_RECLAIM(vn);
-		if (result != 0 && result != EBUSY) {
-			// XXX: lame.
-			kprintf("vfs: Warning: VOP_RECLAIM: %s\n",
-				strerror(result));
+		if (vnode_reclaimwq == NULL ||
+		    work_enqueue(vnode_reclaimwq, vnode_reclaim_work,
+				 vn, 0) != 0) {
+			/* no workers yet, or out of memory: do it now */
+			vnode_reclaim(vn);
 		}
 	}
 }
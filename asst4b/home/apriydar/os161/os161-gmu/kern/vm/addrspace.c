@@ -179,3 +179,16 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+
+unsigned
+as_getstats(struct addrspace *as, struct vmregionstat *stats, unsigned max)
+{
+	/*
+	 * Write this.
+	 */
+
+	(void)as;
+	(void)stats;
+	(void)max;
+	return 0;
+}
@@ -1216,3 +1216,73 @@ kfree(void *ptr)
 	}
 }
 
+
+////////////////////////////////////////////////////////////
+//
+// Buffer cache for big scratch buffers.
+//
+// Some callers need a buffer of a page or more for the length of one
+// operation (exec arguments, sendfile, aio requests, pipes). Giving
+// those back to the page allocator on every call is slow, and dumbvm
+// never takes pages back at all, so kbuf_free keeps them instead: one
+// free list per size in pages, linked through the buffers' first
+// word. Sizes past KBUF_MAXPAGES go straight to kmalloc and kfree.
+//
+
+#define KBUF_MAXPAGES	16
+
+static struct spinlock kbuf_lock = SPINLOCK_INITIALIZER;
+static void *kbuf_spare[KBUF_MAXPAGES];
+
+/*
+ * Allocate a buffer of at least SZ bytes, from the cache if there's
+ * one of the right size.
+ */
+void *
+kbuf_alloc(size_t sz)
+{
+	unsigned long npages;
+	void *buf;
+
+	npages = DIVROUNDUP(sz, PAGE_SIZE);
+	KASSERT(npages > 0);
+	if (npages > KBUF_MAXPAGES) {
+		return kmalloc(sz);
+	}
+
+	spinlock_acquire(&kbuf_lock);
+	buf = kbuf_spare[npages-1];
+	if (buf != NULL) {
+		kbuf_spare[npages-1] = *(void **)buf;
+	}
+	spinlock_release(&kbuf_lock);
+
+	if (buf == NULL) {
+		buf = kmalloc(npages * PAGE_SIZE);
+	}
+	return buf;
+}
+
+/*
+ * Put back a buffer from kbuf_alloc. SZ must be what it was
+ * allocated with.
+ */
+void
+kbuf_free(void *buf, size_t sz)
+{
+	unsigned long npages;
+
+	if (buf == NULL) {
+		return;
+	}
+	npages = DIVROUNDUP(sz, PAGE_SIZE);
+	if (npages > KBUF_MAXPAGES) {
+		kfree(buf);
+		return;
+	}
+
+	spinlock_acquire(&kbuf_lock);
+	*(void **)buf = kbuf_spare[npages-1];
+	kbuf_spare[npages-1] = buf;
+	spinlock_release(&kbuf_lock);
+}